@@ -0,0 +1,137 @@
+// Benchmark for the line diff on large generated files: splitting into lines, the diff itself
+// (interning, trimming and Myers) and writing unified hunks, each timed separately.
+//
+//   make bench-diff                       (100 MiB log by default)
+//   make bench-diff BENCH_ARGS="--size 20"
+#include "../my_git.cpp"
+
+// Deterministic generator so runs are comparable
+static uint64_t nextRandom(uint64_t &state)
+{
+    state += 0x9e3779b97f4a7c15ull;
+    uint64_t z = state;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+// Log lines: almost every line is unique thanks to the timestamp and request id
+static string generateLog(size_t bytes, uint64_t &state)
+{
+    static const char *levels[] = {"INFO", "INFO", "INFO", "DEBUG", "WARN", "ERROR"};
+    static const char *paths[] = {"/api/v1/items", "/api/v1/users", "/healthz", "/api/v2/search", "/static/app.js"};
+    string out;
+    out.reserve(bytes + 256);
+    for (uint64_t line = 0; out.size() < bytes; line++)
+    {
+        uint64_t r = nextRandom(state);
+        out += "2026-10-17T" + to_string(10 + line / 3600000 % 14) + ":" + to_string(10 + line / 60000 % 50) + ":" +
+               to_string(10 + line / 1000 % 50) + "." + to_string(100 + line % 900) + "Z " + levels[r % 6] +
+               " worker-" + to_string(r >> 8 & 31) + " request id=" + to_string(line) + " path=" + paths[(r >> 16) % 5] +
+               "/" + to_string(r >> 20 & 0xffff) + " status=" + to_string((r >> 40 & 7) ? 200 : 500) +
+               " latency=" + to_string(r >> 44 & 1023) + "ms\n";
+    }
+    return out;
+}
+
+// Source-like text: lines drawn from a small vocabulary, so most lines repeat many times and
+// Myers has to do the real work instead of the unique-line shortcut
+static string generateSource(size_t bytes, uint64_t &state)
+{
+    vector<string> vocabulary = {"}", "{", "", "    return 0;", "        break;", "    }", "    else", "#include <vector>"};
+    for (int i = 0; i < 400; i++)
+        vocabulary.push_back("    int value" + to_string(i) + " = compute(" + to_string(i % 17) + ");");
+    string out;
+    out.reserve(bytes + 256);
+    while (out.size() < bytes)
+    {
+        uint64_t r = nextRandom(state);
+        // Skewed towards the short, common lines
+        size_t pick = (r & 3) ? r % 8 : 8 + (r >> 8) % (vocabulary.size() - 8);
+        out += vocabulary[pick] + "\n";
+    }
+    return out;
+}
+
+// Replaces, inserts or deletes `edits` lines at random positions
+static string scatterEdits(const string &text, size_t edits, uint64_t &state)
+{
+    vector<string_view> lines = LineDiff::split(text);
+    set<size_t> positions;
+    while (positions.size() < min(edits, lines.size()))
+        positions.insert(nextRandom(state) % lines.size());
+    string out;
+    out.reserve(text.size() + edits * 64);
+    for (size_t i = 0; i < lines.size(); i++)
+    {
+        if (!positions.count(i))
+        {
+            out.append(lines[i]);
+            continue;
+        }
+        uint64_t r = nextRandom(state);
+        string edited = "edited line " + to_string(r) + "\n";
+        if (r % 3 == 0)
+            out += edited; // replace
+        else if (r % 3 == 1)
+            out += edited + string(lines[i]); // insert
+        // else delete
+    }
+    return out;
+}
+
+static void run(const string &name, const string &before, const string &after)
+{
+    auto seconds = [](chrono::steady_clock::time_point since)
+    { return chrono::duration<double>(chrono::steady_clock::now() - since).count(); };
+    double mib = double(before.size() + after.size()) / (1024 * 1024);
+
+    auto start = chrono::steady_clock::now();
+    vector<string_view> oldLines = LineDiff::split(before), newLines = LineDiff::split(after);
+    double splitTime = seconds(start);
+
+    start = chrono::steady_clock::now();
+    LineDiff diff(oldLines, newLines);
+    double diffTime = seconds(start);
+
+    start = chrono::steady_clock::now();
+    size_t outputBytes = 0, hunks = 0;
+    diff.writeUnified([&](string_view text)
+                      {
+        outputBytes += text.size();
+        for (size_t at = text.find("\n@@ "); at != string_view::npos; at = text.find("\n@@ ", at + 1))
+            hunks++;
+        hunks += text.substr(0, 3) == "@@ "; }, 3);
+    double writeTime = seconds(start);
+
+    double total = splitTime + diffTime + writeTime;
+    cout << name << endl;
+    cout << "  input:   " << setw(8) << mib << " MiB, " << oldLines.size() << " -> " << newLines.size() << " lines" << endl;
+    cout << "  split:   " << setw(8) << splitTime * 1000 << " ms" << endl;
+    cout << "  diff:    " << setw(8) << diffTime * 1000 << " ms" << endl;
+    cout << "  unified: " << setw(8) << writeTime * 1000 << " ms (" << hunks << " hunks, " << outputBytes / 1024
+         << " KiB)" << endl;
+    cout << "  total:   " << setw(8) << total * 1000 << " ms, " << mib / total << " MiB/s" << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t sizeMiB = 100;
+    for (int i = 1; i + 1 < argc; i += 2)
+    {
+        if (string(argv[i]) == "--size")
+            sizeMiB = stoul(argv[i + 1]);
+    }
+    size_t bytes = sizeMiB * 1024 * 1024;
+    uint64_t state = 42;
+    cout << fixed << setprecision(1);
+
+    string log = generateLog(bytes, state);
+    run("log, 1000 scattered edits", log, scatterEdits(log, 1000, state));
+    run("log, 1% appended", log.substr(0, log.rfind('\n', log.size() * 99 / 100) + 1), log);
+
+    // Repetitive text is far costlier per byte, so it gets a tenth of the size
+    string source = generateSource(bytes / 10, state);
+    run("source-like, 1000 scattered edits", source, scatterEdits(source, 1000, state));
+    return 0;
+}
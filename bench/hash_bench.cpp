@@ -0,0 +1,54 @@
+// Micro-benchmark for object hashing: SHA-1 throughput at typical blob sizes, and the cost of
+// turning a digest into its hex name.
+//
+//   make bench-hash
+#include "../my_git.cpp"
+
+// Runs `work` repeatedly for at least `minSeconds`, returning calls per second
+static double measure(const function<void()> &work, double minSeconds = 0.5)
+{
+    size_t calls = 0;
+    auto start = chrono::steady_clock::now();
+    double elapsed = 0;
+    do
+    {
+        for (int i = 0; i < 8; i++)
+            work();
+        calls += 8;
+        elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    } while (elapsed < minSeconds);
+    return calls / elapsed;
+}
+
+int main()
+{
+    cout << fixed << setprecision(1);
+    cout << "SHA-1 (EVP)" << endl;
+    for (size_t size : {size_t(1024), size_t(64 * 1024), size_t(16 * 1024 * 1024)})
+    {
+        string input(size, '\0');
+        for (size_t i = 0; i < size; i++)
+            input[i] = static_cast<char>(i * 2654435761u >> 24);
+        ObjectId sink;
+        double rate = measure([&]
+                              { sink = Sha1::hash(input); input[0] = static_cast<char>(sink.bytes[0]); });
+        cout << "  " << setw(8) << size / 1024 << " KiB: " << setw(12) << rate << " hashes/s  "
+             << setw(8) << rate * size / (1024 * 1024) << " MiB/s" << endl;
+    }
+
+    ObjectId id = Sha1::hash("benchmark");
+    string hex;
+    double tableRate = measure([&]
+                               { hex = id.hex(); id.bytes[0]++; });
+    double streamRate = measure([&]
+                                {
+        stringstream ss;
+        for (unsigned char byte : id.bytes)
+            ss << std::hex << setw(2) << setfill('0') << int(byte);
+        hex = ss.str();
+        id.bytes[0]++; });
+    cout << "Hex encoding" << endl;
+    cout << "  table:        " << setw(12) << tableRate << " ids/s" << endl;
+    cout << "  stringstream: " << setw(12) << streamRate << " ids/s" << endl;
+    return 0;
+}
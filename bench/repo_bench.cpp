@@ -0,0 +1,364 @@
+// Benchmark for core repository operations. Generates a synthetic repository, runs each mygit
+// command as a child process and reports wall time, CPU time, peak RSS and block I/O as JSON.
+//
+//   make bench BENCH_ARGS="--files 20000 --commits 10"
+//
+// Options (defaults in brackets):
+//   --files <n>       files in the generated tree [2000]
+//   --min-size <b>    smallest file size in bytes [64]
+//   --max-size <b>    largest file size in bytes; sizes are log-uniform in between [262144]
+//   --depth <n>       directory levels above each file [3]
+//   --commits <n>     commits in the generated history [5]
+//   --churn <pct>     percentage of files modified per follow-up commit [5]
+//   --seed <n>        random seed [1]
+//   --mygit <path>    mygit binary to benchmark [./mygit]
+//   --dir <path>      scratch directory, removed first [/tmp/mygit-bench]
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <random>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <functional>
+#include <thread>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace std;
+namespace fs = filesystem;
+
+struct Options
+{
+    size_t files = 2000;
+    size_t minSize = 64;
+    size_t maxSize = 256 * 1024;
+    size_t depth = 3;
+    size_t commits = 5;
+    size_t churn = 5;
+    uint64_t seed = 1;
+    string mygit = "./mygit";
+    string dir = "/tmp/mygit-bench";
+};
+
+// Resource usage of one or more runs of an operation
+struct Measurement
+{
+    size_t runs = 0;
+    double wallMs = 0;
+    double userMs = 0;
+    double sysMs = 0;
+    long maxRssKb = 0;
+    uint64_t readBytes = 0;
+    uint64_t writeBytes = 0;
+
+    void add(const Measurement &other)
+    {
+        runs += other.runs;
+        wallMs += other.wallMs;
+        userMs += other.userMs;
+        sysMs += other.sysMs;
+        maxRssKb = max(maxRssKb, other.maxRssKb);
+        readBytes += other.readBytes;
+        writeBytes += other.writeBytes;
+    }
+};
+
+static double toMs(const timeval &tv)
+{
+    return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+}
+
+// Runs mygit with `args` in the repository directory, capturing stdout into `output` and feeding
+// `input` to stdin when given. Resource usage comes from wait4, so it covers exactly the child process.
+static Measurement run(const Options &options, const vector<string> &args, string *output = nullptr,
+                       const string *input = nullptr)
+{
+    int pipeFds[2], inputFds[2] = {-1, -1};
+    if (pipe(pipeFds) != 0 || (input && pipe(inputFds) != 0))
+        throw runtime_error("pipe failed");
+
+    auto start = chrono::steady_clock::now();
+    pid_t pid = fork();
+    if (pid < 0)
+        throw runtime_error("fork failed");
+    if (pid == 0)
+    {
+        if (chdir(options.dir.c_str()) != 0)
+            _exit(127);
+        dup2(pipeFds[1], STDOUT_FILENO);
+        int devNull = open("/dev/null", O_WRONLY);
+        dup2(devNull, STDERR_FILENO);
+        close(pipeFds[0]);
+        if (input)
+        {
+            dup2(inputFds[0], STDIN_FILENO);
+            close(inputFds[1]);
+        }
+        vector<char *> argv;
+        argv.push_back(const_cast<char *>(options.mygit.c_str()));
+        for (const string &arg : args)
+            argv.push_back(const_cast<char *>(arg.c_str()));
+        argv.push_back(nullptr);
+        execv(argv[0], argv.data());
+        _exit(127);
+    }
+
+    close(pipeFds[1]);
+    // Feed stdin from another thread so a child blocked on a full stdout pipe cannot deadlock us
+    thread feeder;
+    if (input)
+    {
+        close(inputFds[0]);
+        feeder = thread([&]
+                        {
+            for (size_t done = 0; done < input->size();)
+            {
+                ssize_t written = write(inputFds[1], input->data() + done, input->size() - done);
+                if (written <= 0)
+                    break;
+                done += written;
+            }
+            close(inputFds[1]); });
+    }
+    string captured;
+    char buffer[65536];
+    ssize_t length;
+    while ((length = read(pipeFds[0], buffer, sizeof(buffer))) > 0)
+    {
+        if (output)
+            captured.append(buffer, length);
+    }
+    close(pipeFds[0]);
+    if (feeder.joinable())
+        feeder.join();
+
+    int status = 0;
+    rusage usage = {};
+    if (wait4(pid, &status, 0, &usage) < 0)
+        throw runtime_error("wait4 failed");
+    auto end = chrono::steady_clock::now();
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+    {
+        string command = "mygit";
+        for (const string &arg : args)
+            command += " " + arg;
+        throw runtime_error("'" + command + "' failed with status " + to_string(WEXITSTATUS(status)));
+    }
+    if (output)
+        *output = move(captured);
+
+    Measurement m;
+    m.runs = 1;
+    m.wallMs = chrono::duration<double, milli>(end - start).count();
+    m.userMs = toMs(usage.ru_utime);
+    m.sysMs = toMs(usage.ru_stime);
+    m.maxRssKb = usage.ru_maxrss;
+    // Block counts are in 512-byte units and only include I/O that reached the block layer
+    m.readBytes = uint64_t(usage.ru_inblock) * 512;
+    m.writeBytes = uint64_t(usage.ru_oublock) * 512;
+    return m;
+}
+
+class RepoGenerator
+{
+    const Options &options;
+    mt19937_64 random;
+    vector<string> paths;
+
+    size_t pickSize()
+    {
+        uniform_real_distribution<double> exponent(log(double(options.minSize)), log(double(options.maxSize)));
+        return static_cast<size_t>(exp(exponent(random)));
+    }
+
+    // Text-like content so compression behaves as it does on source trees
+    void writeFile(const string &path)
+    {
+        static const string words[] = {"int ", "return ", "value", "(", ")", ";\n", "{\n", "}\n", "mygit ", "object ",
+                                       "tree ", "commit ", "0x1f ", "const ", "auto ", "// note\n"};
+        size_t size = pickSize();
+        string content;
+        content.reserve(size + 16);
+        while (content.size() < size)
+            content += words[random() % (sizeof(words) / sizeof(words[0]))];
+        content.resize(size);
+        // Replace rather than truncate: ext4 starts writeback on truncate-and-rewrite, which would
+        // charge the generator's own disk wait to the next command that touches the file
+        string fullPath = options.dir + "/" + path;
+        unlink(fullPath.c_str());
+        ofstream file(fullPath, ios::binary | ios::trunc);
+        file << content;
+    }
+
+public:
+    uint64_t totalBytes = 0;
+
+    RepoGenerator(const Options &opts) : options(opts), random(opts.seed) {}
+
+    const vector<string> &files() const { return paths; }
+
+    void createTree()
+    {
+        for (size_t i = 0; i < options.files; i++)
+        {
+            string dir;
+            size_t rest = i;
+            for (size_t level = 0; level < options.depth; level++)
+            {
+                dir += "d" + to_string(rest % 8) + "/";
+                rest /= 8;
+            }
+            fs::create_directories(options.dir + "/" + dir);
+            paths.push_back(dir + "f" + to_string(i) + ".txt");
+            writeFile(paths.back());
+        }
+        for (const string &path : paths)
+            totalBytes += fs::file_size(options.dir + "/" + path);
+    }
+
+    // Rewrites churn% of the files with new content
+    void modifySome()
+    {
+        size_t count = max<size_t>(1, paths.size() * options.churn / 100);
+        for (size_t i = 0; i < count; i++)
+            writeFile(paths[random() % paths.size()]);
+    }
+};
+
+static void printJson(const Options &options, const RepoGenerator &generator,
+                      const vector<pair<string, Measurement>> &results)
+{
+    cout << fixed;
+    cout << "{\n  \"repository\": {\"files\": " << options.files << ", \"bytes\": " << generator.totalBytes
+         << ", \"depth\": " << options.depth << ", \"commits\": " << options.commits << ", \"churn_percent\": "
+         << options.churn << ", \"min_size\": " << options.minSize << ", \"max_size\": " << options.maxSize
+         << ", \"seed\": " << options.seed << "},\n  \"operations\": [\n";
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const auto &[name, m] = results[i];
+        cout << "    {\"name\": \"" << name << "\", \"runs\": " << m.runs << setprecision(3) << ", \"wall_ms\": "
+             << m.wallMs << ", \"user_ms\": " << m.userMs << ", \"sys_ms\": " << m.sysMs
+             << ", \"cpu_ms\": " << m.userMs + m.sysMs << ", \"max_rss_kb\": " << m.maxRssKb
+             << ", \"read_bytes\": " << m.readBytes << ", \"write_bytes\": " << m.writeBytes << "}"
+             << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    cout << "  ]\n}" << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    Options options;
+    for (int i = 1; i < argc; i++)
+    {
+        string option = argv[i];
+        if (i + 1 >= argc)
+        {
+            cerr << "Missing value for " << option << endl;
+            return 1;
+        }
+        string value = argv[++i];
+        if (option == "--files")
+            options.files = stoul(value);
+        else if (option == "--min-size")
+            options.minSize = max<size_t>(1, stoul(value));
+        else if (option == "--max-size")
+            options.maxSize = stoul(value);
+        else if (option == "--depth")
+            options.depth = stoul(value);
+        else if (option == "--commits")
+            options.commits = max<size_t>(1, stoul(value));
+        else if (option == "--churn")
+            options.churn = stoul(value);
+        else if (option == "--seed")
+            options.seed = stoull(value);
+        else if (option == "--mygit")
+            options.mygit = value;
+        else if (option == "--dir")
+            options.dir = value;
+        else
+        {
+            cerr << "Unknown option " << option << endl;
+            return 1;
+        }
+    }
+    options.maxSize = max(options.maxSize, options.minSize);
+    options.mygit = fs::absolute(options.mygit).string();
+
+    try
+    {
+        fs::remove_all(options.dir);
+        fs::create_directories(options.dir);
+        RepoGenerator generator(options);
+        cerr << "Generating " << options.files << " files in " << options.dir << "..." << endl;
+        generator.createTree();
+
+        vector<pair<string, Measurement>> results;
+        auto record = [&](const string &name, const Measurement &m)
+        {
+            for (auto &[existing, total] : results)
+            {
+                if (existing == name)
+                {
+                    total.add(m);
+                    return;
+                }
+            }
+            results.emplace_back(name, m);
+        };
+        auto head = [&]
+        {
+            ifstream file(options.dir + "/.mygit/HEAD");
+            string sha;
+            getline(file, sha);
+            return sha;
+        };
+
+        record("init", run(options, {"init"}));
+        record("add . (initial)", run(options, {"add", "."}));
+        record("commit (initial)", run(options, {"commit", "-m", "initial"}));
+        string firstCommit = head();
+        record("add . (no changes)", run(options, {"add", "."}));
+
+        for (size_t c = 1; c < options.commits; c++)
+        {
+            generator.modifySome();
+            record("add . (incremental)", run(options, {"add", "."}));
+            record("commit (incremental)", run(options, {"commit", "-m", "change " + to_string(c)}));
+        }
+        string lastCommit = head();
+
+        string treeSha;
+        record("write-tree", run(options, {"write-tree"}, &treeSha));
+        record("log", run(options, {"log"}));
+        record("cat-file -p commit", run(options, {"cat-file", "-p", lastCommit}));
+        record("ls-tree", run(options, {"ls-tree", treeSha.substr(0, treeSha.find('\n'))}));
+
+        // Every loose object, as a tool that scans the whole store would request them
+        string objectList;
+        for (const auto &entry : fs::recursive_directory_iterator(options.dir + "/.mygit/objects"))
+        {
+            string name = entry.path().filename().string();
+            string dir = entry.path().parent_path().filename().string();
+            if (entry.is_regular_file() && dir.size() == 2 && name.size() == 38)
+                objectList += dir + name + "\n";
+        }
+        record("cat-file --batch-check (all objects)", run(options, {"cat-file", "--batch-check"}, nullptr, &objectList));
+        record("cat-file --batch (all objects)", run(options, {"cat-file", "--batch"}, nullptr, &objectList));
+        record("checkout (first commit)", run(options, {"checkout", firstCommit}));
+        record("checkout (last commit)", run(options, {"checkout", lastCommit}));
+
+        printJson(options, generator, results);
+    }
+    catch (const exception &e)
+    {
+        cerr << "Error: " << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}
@@ -1,8 +1,11 @@
 #include <iostream>
+#include <iomanip>
+#include <sstream>
 #include <string>
 #include <vector>
 #include <bits/stdc++.h>
-#include "my_git.cpp"
+#include "mygit.h"
+using namespace std;
 
 void printUsage()
 {
@@ -11,11 +14,165 @@ void printUsage()
          << "   init                    Create an empty MyGit repository\n"
          << "   hash-object [-w] <file> Compute object ID and optionally write the object\n"
          << "   cat-file [-p|-t|-s] <object> Show object content, type, or size\n"
+         << "   cat-file --batch|--batch-check [-j <n>] Show objects named on stdin, one per line\n"
          << "   write-tree              Write the working directory as a tree object\n"
          << "   ls-tree [--name-only] <tree-sha> List contents of a tree object\n"
-         << "   add <file(s)>           Add file(s) to the staging area\n"
+         << "   add [--refresh] [-j <n>] <file(s)> Add file(s) to the staging area using n threads\n"
          << "   commit -m \"<msg>\"       Commit changes to the repository\n"
-         << "   log                     Show commit logs\n";
+         << "   status [-j <n>]         Show staged, unstaged and untracked files\n"
+         << "   fsmonitor start|stop|status Manage the file-watching daemon used by add . and status\n"
+         << "   log [-n <count>]        Show commit logs\n"
+         << "   diff [-U<n>] <a> <b>     Show line changes between two commits, trees or blobs\n"
+         << "   diff --name-status <a> <b> List files that differ between two commits or trees\n"
+         << "   commit-graph write      Write the commit-graph file used to speed up history walks\n"
+         << "   merge-base --is-ancestor <a> <b> Exit 0 if commit a is an ancestor of commit b\n"
+         << "   checkout [-f] [-j <n>] <commit> Check out a commit using n writer threads (-f discards local changes)\n"
+         << "   gc | repack             Pack all objects into a delta-compressed pack file\n"
+         << "   fsck [-j <n>]           Verify every object and report corrupt, missing and dangling ones\n";
+}
+
+// A malformed command line; main prints the message followed by the usage text
+struct UsageError : runtime_error
+{
+    using runtime_error::runtime_error;
+};
+
+// Parses a non-negative decimal count that fills all of `text` ("4", not "-1", "4x" or "")
+template <typename Number>
+Number parseCount(const string &text, const string &what)
+{
+    Number value = 0;
+    auto [end, error] = from_chars(text.data(), text.data() + text.size(), value);
+    if (text.empty() || error != errc() || end != text.data() + text.size())
+    {
+        throw UsageError("Invalid " + what + ": '" + text + "'");
+    }
+    return value;
+}
+
+// Parses "-j <n>" or "-j<n>" at argv[argIndex], advancing argIndex past it; returns false otherwise
+bool parseJobsOption(int argc, char *argv[], int &argIndex, unsigned &jobs)
+{
+    if (argIndex >= argc || string(argv[argIndex]).rfind("-j", 0) != 0)
+    {
+        return false;
+    }
+    string value = string(argv[argIndex]).substr(2);
+    if (value.empty() && argIndex + 1 < argc)
+    {
+        value = argv[++argIndex];
+    }
+    jobs = parseCount<unsigned>(value, "thread count for -j");
+    argIndex++;
+    return true;
+}
+
+// Finishes an add/checkout/fsck summary line with "Ts using N threads [f files/s, m MiB/s]"
+void printThroughput(double mib, size_t files, double seconds, unsigned threads, const char *unit = "files")
+{
+    cout << fixed << setprecision(3) << seconds << "s using " << threads << " thread" << (threads == 1 ? "" : "s");
+    if (seconds > 0)
+    {
+        cout << " [" << setprecision(0) << files / seconds << " " << unit << "/s, "
+             << setprecision(1) << mib / seconds << " MiB/s]";
+    }
+    cout << defaultfloat << endl;
+}
+
+// cat-file --batch / --batch-check: answers one object name per stdin line with
+// "<sha> <type> <size>" (followed by the content and a newline for --batch) or "<name> missing".
+// Whatever input is already available is read in one go and its objects are loaded by `jobs`
+// threads; output is buffered and flushed before waiting for more input, so a client that sends
+// one name at a time still gets each answer immediately.
+void catFileBatch(Repository &git, bool withContent, unsigned jobs)
+{
+    const size_t flushThreshold = 1 << 20;
+    string input, output;
+    char buffer[65536];
+    bool done = false;
+    while (!done)
+    {
+        ssize_t length = read(STDIN_FILENO, buffer, sizeof(buffer));
+        if (length < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            throw runtime_error("Cannot read standard input");
+        }
+        if (length == 0)
+        {
+            done = true;
+            if (!input.empty() && input.back() != '\n')
+                input += '\n'; // Last line without a trailing newline
+        }
+        input.append(buffer, length);
+
+        vector<string> names;
+        size_t start = 0, newline;
+        while ((newline = input.find('\n', start)) != string::npos)
+        {
+            names.push_back(input.substr(start, newline - start));
+            start = newline + 1;
+        }
+        input.erase(0, start);
+        if (names.empty())
+            continue;
+
+        if (withContent)
+        {
+            // Chunked blobs are streamed to stdout one chunk at a time; the rest are loaded in parallel
+            vector<ObjectInfo> infos = git.readObjectInfo(names, jobs);
+            vector<string> whole;
+            for (size_t i = 0; i < names.size(); i++)
+            {
+                if (!infos[i].type.empty() && !infos[i].chunked)
+                    whole.push_back(names[i]);
+            }
+            vector<ObjectData> objects = git.readObjects(whole, jobs);
+            size_t next = 0;
+            for (size_t i = 0; i < names.size(); i++)
+            {
+                if (infos[i].chunked)
+                {
+                    output += names[i] + " blob " + to_string(infos[i].size) + "\n";
+                    cout.write(output.data(), output.size());
+                    output.clear();
+                    git.streamObject(names[i], [](string_view chunk)
+                                     { cout.write(chunk.data(), chunk.size()); });
+                    output += '\n';
+                    continue;
+                }
+                if (infos[i].type.empty() || objects[next].type.empty())
+                {
+                    next += !infos[i].type.empty();
+                    output += names[i] + " missing\n";
+                    continue;
+                }
+                const ObjectData &object = objects[next++];
+                output += names[i] + " " + object.type + " " + to_string(object.content.size()) + "\n";
+                output.append(object.content);
+                output += '\n';
+                if (output.size() >= flushThreshold)
+                {
+                    cout.write(output.data(), output.size());
+                    output.clear();
+                }
+            }
+        }
+        else
+        {
+            vector<ObjectInfo> infos = git.readObjectInfo(names, jobs);
+            for (size_t i = 0; i < names.size(); i++)
+            {
+                if (infos[i].type.empty())
+                    output += names[i] + " missing\n";
+                else
+                    output += names[i] + " " + infos[i].type + " " + to_string(infos[i].size) + "\n";
+            }
+        }
+        cout.write(output.data(), output.size()).flush();
+        output.clear();
+    }
 }
 
 int main(int argc, char *argv[])
@@ -31,7 +188,6 @@ int main(int argc, char *argv[])
     }
 
     string command = argv[1];
-    MyGit git;
 
     // cout<<"command is "<<command<<endl;
 
@@ -39,9 +195,13 @@ int main(int argc, char *argv[])
     {
         if (command == "init")
         {
-            return git.init() ? 0 : 1;
+            Repository repo = Repository::init(".");
+            cout << "Initialized empty MyGit repository in " << filesystem::path(repo.root()) / ".mygit" << endl;
+            return 0;
         }
-        else if (command == "hash-object")
+
+        Repository git = Repository::open(".");
+        if (command == "hash-object")
         {
             if (argc < 3)
             {
@@ -71,21 +231,47 @@ int main(int argc, char *argv[])
         }
         else if (command == "cat-file")
         {
-            if (argc < 4)
+            if (argc >= 3 && (string(argv[2]) == "--batch" || string(argv[2]) == "--batch-check"))
             {
-                cerr << "Error: Missing flag or object argument" << endl;
-                return 1;
+                // Optional -j <threads> sets how many objects are loaded in parallel
+                unsigned jobs = 0;
+                int argIndex = 3;
+                parseJobsOption(argc, argv, argIndex, jobs);
+                catFileBatch(git, string(argv[2]) == "--batch", jobs);
             }
-
-            string flag = argv[2];
-            if (flag.length() != 2 || flag[0] != '-' ||
-                (flag[1] != 'p' && flag[1] != 't' && flag[1] != 's'))
+            else
             {
-                cerr << "Error: Invalid flag" << endl;
-                return 1;
-            }
+                if (argc < 4)
+                {
+                    cerr << "Error: Missing flag or object argument" << endl;
+                    return 1;
+                }
 
-            git.catFile(argv[3], flag[1]);
+                string flag = argv[2];
+                if (flag.length() != 2 || flag[0] != '-' ||
+                    (flag[1] != 'p' && flag[1] != 't' && flag[1] != 's'))
+                {
+                    cerr << "Error: Invalid flag" << endl;
+                    return 1;
+                }
+
+                if (flag[1] == 'p')
+                {
+                    git.streamObject(argv[3], [](string_view content)
+                                     { cout.write(content.data(), content.size()); });
+                    cout << "\n";
+                }
+                else
+                {
+                    ObjectInfo info = git.readObjectInfo({argv[3]})[0];
+                    if (info.type.empty())
+                        throw runtime_error("Object not found: " + string(argv[3]));
+                    if (flag[1] == 't')
+                        cout << info.type << endl;
+                    else
+                        cout << info.size << endl;
+                }
+            }
         }
         else if (command == "write-tree")
         {
@@ -119,43 +305,47 @@ int main(int argc, char *argv[])
                 treeSha = argv[2];
             }
 
-            git.listTree(treeSha, nameOnly);
-        }
-        else if (command == "add" && argc == 3 && string(argv[2]) == ".")
-        {
-            vector<string> files;
-
-            // Recursively traverse the current directory
-            for (const auto &entry : fs::recursive_directory_iterator("."))
+            for (const TreeEntry &entry : git.listTree(treeSha))
             {
-                // Skip files or directories inside the .mygit directory
-                if (entry.path().string().find(".mygit") != string::npos or entry.path().string().find(".git") != string::npos)
-                    continue;
-
-                // Add regular files to the files vector
-                if (entry.is_regular_file())
+                if (nameOnly)
+                {
+                    cout << entry.name << endl; // Print only names if --name-only flag is used
+                }
+                else
                 {
-                    string temp=entry.path().string();
-                    temp=temp.substr(2);
-                    // cout<<"file="<<temp<<endl;
-                    
-                    files.push_back(temp);
+                    cout << entry.mode << " " << entry.type << " " << entry.sha << " " << entry.name << endl;
                 }
             }
-
-            // Pass the collected files to git.addFiles
-            git.addFiles(files);
         }
         else if (command == "add")
         {
-            if (argc < 3)
+            // Optional -j <threads> (or -j<threads>) controls the staging worker pool,
+            // --refresh rehashes files even when their stat data says they are unchanged
+            unsigned jobs = 0;
+            bool refresh = false;
+            int argIndex = 2;
+            while (argIndex < argc)
+            {
+                if (string(argv[argIndex]) == "--refresh")
+                {
+                    refresh = true;
+                    argIndex++;
+                }
+                else if (!parseJobsOption(argc, argv, argIndex, jobs))
+                {
+                    break;
+                }
+            }
+
+            if (argIndex >= argc)
             {
                 cerr << "No files specified for add command." << endl;
                 return 1;
             }
 
+            // "." on its own recursively traverses the current directory
             vector<string> files;
-            for (int i = 2; i < argc; ++i)
+            for (int i = argIndex; i < argc; ++i)
             {
                 string temp=argv[i];
                 if(temp[0]=='.' and temp[1]=='/')
@@ -165,7 +355,20 @@ int main(int argc, char *argv[])
                 files.push_back(temp);
             }
 
-            git.addFiles(files);
+            AddResult added = git.add(files, {jobs, refresh});
+            for (const PathChange &change : added.changes)
+            {
+                if (change.label == "removed")
+                    cout << "Removed " << change.path << " from the index." << endl;
+                else
+                    cout << "Added " << change.path << " to the index." << endl;
+            }
+            double mib = added.bytesHashed / (1024.0 * 1024.0);
+            cout << "Hashed " << added.filesHashed << " of " << added.filesSeen << " files (" << fixed << setprecision(1)
+                 << mib << " MiB, " << added.filesSeen - added.filesHashed << " unchanged) in ";
+            printThroughput(mib, added.filesSeen, added.seconds, added.threads);
+            cout << "Objects written: " << added.objectsWritten
+                 << ", already stored (deduplicated): " << added.objectsDeduplicated << endl;
         }
         else if (command == "commit")
         {
@@ -182,22 +385,259 @@ int main(int argc, char *argv[])
             }
 
             // Create the commit
-            git.commitChanges(message);
+            CommitResult commit = git.commit(message);
+            if (commit.parent.empty())
+            {
+                cout << "This is the first commit." << endl;
+            }
+            if (commit.filesChanged == 0)
+            {
+                cout << "0 changes to commit" << endl;
+            }
+            cout << "[main " << commit.sha.substr(0, 7) << "] " << commit.message << "\n";
+            cout << "Files changed: " << commit.filesChanged << endl;
+        }
+        else if (command == "status")
+        {
+            // Optional -j <threads> sets the number of directory scan threads
+            unsigned jobs = 0;
+            int argIndex = 2;
+            parseJobsOption(argc, argv, argIndex, jobs);
+            StatusResult status = git.status(jobs);
+            if (status.head.empty())
+                cout << "No commits yet" << endl;
+            else
+                cout << "On commit " << status.head << endl;
+
+            auto printChanges = [](const string &heading, const vector<PathChange> &changes)
+            {
+                if (changes.empty())
+                    return;
+                cout << endl
+                     << heading << ":" << endl;
+                for (const PathChange &change : changes)
+                {
+                    cout << "  " << left << setw(12) << change.label + ":" << change.path << endl;
+                }
+            };
+            printChanges("Changes to be committed", status.staged);
+            printChanges("Changes not staged for commit", status.unstaged);
+            if (!status.untracked.empty())
+            {
+                cout << endl
+                     << "Untracked files:" << endl;
+                for (const string &path : status.untracked)
+                    cout << "  " << path << endl;
+            }
+            if (status.clean())
+            {
+                cout << "nothing to commit, working tree clean" << endl;
+            }
+        }
+        else if (command == "fsmonitor")
+        {
+            if (argc < 3)
+            {
+                cerr << "Usage: ./mygit fsmonitor start|stop|status" << endl;
+                return 1;
+            }
+            string action = argv[2];
+            if (action == "status")
+            {
+                bool running = git.fsmonitorRunning();
+                cout << (running ? "fsmonitor is running" : "fsmonitor is not running") << endl;
+                return running ? 0 : 1;
+            }
+            if (action == "stop")
+            {
+                if (!git.stopFsMonitor())
+                {
+                    cerr << "fsmonitor is not running" << endl;
+                    return 1;
+                }
+                cout << "fsmonitor stopped" << endl;
+                return 0;
+            }
+            if (action != "start")
+            {
+                throw runtime_error("Unknown fsmonitor action: " + action);
+            }
+            pid_t pid = git.startFsMonitor();
+            if (pid == 0)
+            {
+                cout << "fsmonitor is already running" << endl;
+                return 0;
+            }
+            cout << "fsmonitor started (pid " << pid << ")" << endl;
+            if (!git.fsmonitorEnabled())
+                cout << "Set fsmonitor = true in the [core] section of .mygit/config to use it" << endl;
+        }
+        else if (command == "diff")
+        {
+            // --name-status lists the changed files; otherwise print a unified diff with
+            // -U<n> lines of context (3 by default)
+            bool nameStatus = false;
+            unsigned context = 3;
+            int argIndex = 2;
+            for (; argIndex < argc && argv[argIndex][0] == '-'; argIndex++)
+            {
+                string option = argv[argIndex];
+                if (option == "--name-status")
+                    nameStatus = true;
+                else if (option.rfind("-U", 0) == 0 && option.size() > 2)
+                    context = parseCount<unsigned>(option.substr(2), "context line count for -U");
+                else
+                    break;
+            }
+            if (argc - argIndex != 2)
+            {
+                cerr << "Usage: ./mygit diff [--name-status | -U<n>] <commit> <commit>" << endl;
+                return 1;
+            }
+            if (nameStatus)
+            {
+                for (const DiffEntry &change : git.diff(argv[argIndex], argv[argIndex + 1]))
+                {
+                    cout << change.status << "\t" << change.path << endl;
+                }
+            }
+            else
+            {
+                git.diffPatch(argv[argIndex], argv[argIndex + 1], [](string_view text)
+                              { cout.write(text.data(), text.size()); }, context);
+                cout.flush();
+            }
         }
         else if (command == "log")
         {
-            git.logCommits();
+            // Optional -n <count> limits how many commits are shown
+            size_t maxCount = 0;
+            if (argc >= 4 && string(argv[2]) == "-n")
+            {
+                maxCount = parseCount<size_t>(argv[3], "commit count for -n");
+            }
+            for (const LogEntry &entry : git.log(maxCount))
+            {
+                cout << "commit " << entry.sha << endl;
+                if (!entry.parent.empty())
+                {
+                    cout << "parent " << entry.parent << endl;
+                }
+                cout<<"commit message :"<< entry.message << endl;
+
+                // Format and print the timestamp
+                if (entry.timestamp != 0)
+                {
+                    tm *gmt = gmtime(&entry.timestamp); // Get UTC time
+                    stringstream ss;
+                    ss << put_time(gmt, "%Y-%m-%d %H:%M:%S UTC");
+                    cout<<"date and time :"<<ss.str()<<endl;
+                }
+                else
+                {
+                    cout << " (invalid timestamp)" << endl;
+                }
+
+                cout<<"commiter info: "<<entry.committer<<endl<<endl;
+            }
+        }
+        else if (command == "commit-graph")
+        {
+            if (argc < 3 || string(argv[2]) != "write")
+            {
+                cerr << "Usage: ./mygit commit-graph write" << endl;
+                return 1;
+            }
+            cout << "Wrote commit-graph with " << git.writeCommitGraph() << " commits" << endl;
+        }
+        else if (command == "merge-base")
+        {
+            if (argc < 5 || string(argv[2]) != "--is-ancestor")
+            {
+                cerr << "Usage: ./mygit merge-base --is-ancestor <commit> <commit>" << endl;
+                return 1;
+            }
+            // Exit status answers the query, like git
+            return git.isAncestor(argv[3], argv[4]) ? 0 : 1;
+        }
+        else if (command == "gc" || command == "repack")
+        {
+            RepackResult packed = git.repack();
+            if (packed.objects == 0)
+            {
+                cout << "Nothing to pack" << endl;
+            }
+            else
+            {
+                cout << "Packed " << packed.objects << " objects (" << packed.deltas << " deltas) into "
+                     << packed.packName << ".pack" << endl;
+                if (packed.commitGraphCommits > 0)
+                {
+                    cout << "Wrote commit-graph with " << packed.commitGraphCommits << " commits" << endl;
+                }
+                cout << "Removed " << packed.looseObjectsRemoved << " loose objects (" << packed.looseBytesRemoved / 1024
+                     << " KiB), pack is " << packed.packBytes / 1024 << " KiB" << endl;
+            }
+        }
+        else if (command == "fsck")
+        {
+            // Optional -j <threads> sets the number of verification threads
+            unsigned jobs = 0;
+            int argIndex = 2;
+            parseJobsOption(argc, argv, argIndex, jobs);
+            FsckResult result = git.fsck(jobs);
+            for (const FsckIssue &issue : result.corrupt)
+            {
+                cout << "corrupt " << (issue.type.empty() ? "object" : issue.type) << " " << issue.sha << ": "
+                     << issue.detail << endl;
+            }
+            for (const FsckIssue &issue : result.missing)
+            {
+                cout << "missing " << issue.type << " " << issue.sha << " (" << issue.detail << ")" << endl;
+            }
+            for (const FsckIssue &issue : result.dangling)
+            {
+                cout << "dangling " << issue.type << " " << issue.sha << endl;
+            }
+            size_t objects = result.looseObjects + result.packedObjects;
+            cout << "Checked " << objects << " objects (" << result.looseObjects << " loose, " << result.packedObjects
+                 << " packed) in ";
+            printThroughput(result.bytes / (1024.0 * 1024.0), objects, result.seconds, result.threads, "objects");
+            return result.ok() ? 0 : 1;
         }
         else if (command=="checkout")
         {
-            string sha= argv[2];
+            // Optional -j <threads> (or -j<threads>) sets the number of writer threads; -f discards local changes
+            unsigned jobs = 0;
+            bool force = false;
+            int argIndex = 2;
+            while (argIndex < argc)
+            {
+                if (string(argv[argIndex]) == "-f")
+                {
+                    force = true;
+                    argIndex++;
+                }
+                else if (!parseJobsOption(argc, argv, argIndex, jobs))
+                {
+                    break;
+                }
+            }
+            if (argIndex >= argc)
+            {
+                cerr << "Error: Missing commit SHA" << endl;
+                return 1;
+            }
+            string sha= argv[argIndex];
 
             // cout<<"sha="<<sha<<endl;
 
-            git.checkout(sha);
-
-
-
+            CheckoutResult result = git.checkout(sha, jobs, force);
+            cout << "Checked out commit " << result.commit << " (" << result.written << " written, "
+                 << result.deleted << " deleted, " << result.unchanged << " unchanged)" << endl;
+            double mib = result.bytesWritten / (1024.0 * 1024.0);
+            cout << "Wrote " << fixed << setprecision(1) << mib << " MiB in ";
+            printThroughput(mib, result.written, result.seconds, result.threads);
         }
         else
         {
@@ -205,6 +645,21 @@ int main(int argc, char *argv[])
             printUsage();
             return 1;
         }
+
+        // MYGIT_CACHE_STATS=1 reports how well the object cache served this command
+        const char *cacheStats = getenv("MYGIT_CACHE_STATS");
+        if (cacheStats && string(cacheStats) != "0")
+        {
+            ObjectCacheStats stats = git.objectCacheStats();
+            cerr << "object cache: " << stats.hits << " hits, " << stats.misses << " misses, "
+                 << stats.evictions << " evictions, " << stats.entries << " objects / " << stats.bytes << " bytes cached" << endl;
+        }
+    }
+    catch (const UsageError &e)
+    {
+        cerr << "Error: " << e.what() << endl;
+        printUsage();
+        return 1;
     }
     catch (const exception &e)
     {
@@ -1,874 +1,6397 @@
+#include "mygit.h"
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include <string>
+#include <string_view>
+#include <array>
+#include <cctype>
 #include <vector>
 #include <filesystem>
 #include <openssl/sha.h>
+#include <openssl/evp.h>
 #include <zlib.h>
+#ifdef MYGIT_WITH_ZSTD
+#include <zstd.h>
+#endif
 #include <sys/stat.h>
 #include <cstring>
 #include <set>
 #include <ctime>
 #include <map>
 #include <iomanip>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <chrono>
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <algorithm>
+#include <memory>
+#include <optional>
+#include <list>
+#include <unordered_map>
+#include <unordered_set>
+#include <climits>
+#include <charconv>
+#include <fcntl.h>
+#include <dirent.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include <unistd.h>
 using namespace std;
 namespace fs = filesystem;
 
-class MyGit
+// Blocking FIFO shared between a producer (e.g. a directory walk) and worker threads
+template <typename T>
+class WorkQueue
 {
 private:
-    const string GIT_DIR = ".mygit";
-    const string OBJECTS_DIR = (fs::current_path() / GIT_DIR / "objects").string();
+    deque<T> items;
+    mutex lock;
+    condition_variable ready;
+    bool closed = false;
 
-    // Helper function to create directory if it doesn't exist
-    bool createDirectory(const string &path)
+public:
+    void push(T item)
     {
-        try
         {
-            if (!fs::exists(path))
+            lock_guard<mutex> guard(lock);
+            items.push_back(move(item));
+        }
+        ready.notify_one();
+    }
+
+    // No more items will be pushed; wakes up idle workers so they can exit
+    void close()
+    {
+        {
+            lock_guard<mutex> guard(lock);
+            closed = true;
+        }
+        ready.notify_all();
+    }
+
+    // Returns false once the queue is closed and drained
+    bool pop(T &item)
+    {
+        unique_lock<mutex> guard(lock);
+        ready.wait(guard, [this]
+                   { return !items.empty() || closed; });
+        if (items.empty())
+            return false;
+        item = move(items.front());
+        items.pop_front();
+        return true;
+    }
+};
+
+// Helper function to turn a requested -j value into a usable thread count
+inline unsigned resolveJobCount(unsigned jobs)
+{
+    if (jobs > 0)
+        return jobs;
+    unsigned hw = thread::hardware_concurrency();
+    return hw > 0 ? hw : 1;
+}
+
+// Helper function to call work(i) for every i in [0, count) across `jobs` threads.
+// The first exception thrown by any call is rethrown once all threads have stopped.
+inline void runParallel(size_t count, unsigned jobs, const function<void(size_t)> &work)
+{
+    atomic<size_t> next{0};
+    atomic<bool> failed{false};
+    exception_ptr error;
+    mutex errorLock;
+
+    auto worker = [&]
+    {
+        for (size_t i = next++; i < count && !failed; i = next++)
+        {
+            try
             {
-                return fs::create_directories(path);
+                work(i);
+            }
+            catch (...)
+            {
+                lock_guard<mutex> guard(errorLock);
+                if (!error)
+                    error = current_exception();
+                failed = true;
             }
-            return true;
         }
-        catch (const exception &e)
+    };
+
+    jobs = max<unsigned>(1, min<size_t>(jobs, count));
+    vector<thread> threads;
+    for (unsigned t = 1; t < jobs; t++)
+        threads.emplace_back(worker);
+    worker(); // The calling thread works too
+    for (thread &t : threads)
+        t.join();
+    if (error)
+        rethrow_exception(error);
+}
+
+// Helper function to write a whole buffer to a file descriptor
+inline void writeAll(int fd, const char *data, size_t length)
+{
+    while (length > 0)
+    {
+        ssize_t written = write(fd, data, length);
+        if (written < 0)
         {
-            cerr << "Error creating directory: " << e.what() << endl;
+            if (errno == EINTR)
+                continue;
+            throw runtime_error(string("write failed: ") + strerror(errno));
+        }
+        data += written;
+        length -= written;
+    }
+}
+
+// Helper function to name a temporary file "<prefix><pid>_<n>", unique within the process
+inline string tempFileName(const string &prefix)
+{
+    static atomic<uint64_t> counter{0};
+    return prefix + to_string(getpid()) + "_" + to_string(counter++);
+}
+
+// Helper function to create a temporary file like mkstemp, but with mode 0644 (less the umask)
+// rather than 0600, so objects and packs renamed from it stay readable in shared repositories
+inline int createTempFile(const string &prefix, string &path)
+{
+    for (int attempt = 0; attempt < 16; attempt++)
+    {
+        path = tempFileName(prefix);
+        int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+        if (fd >= 0)
+            return fd;
+        if (errno != EEXIST) // EEXIST only for a file left behind by an earlier process with this pid
+            break;
+    }
+    path.clear(); // nothing to clean up
+    return -1;
+}
+
+// Lightweight tracing, switched on by the MYGIT_TRACE environment variable:
+//   MYGIT_TRACE=1            print a table of timed operations and counters to stderr at exit
+//   MYGIT_TRACE=<file.json>  write every timed span as Chrome trace-event JSON instead
+//                            (load it in chrome://tracing or ui.perfetto.dev)
+// When it is unset, a TraceScope costs one well-predicted branch and nothing is recorded.
+// Scopes nest, so a parent's time includes its children's.
+class Trace
+{
+    struct Span
+    {
+        const char *name;
+        uint32_t thread;
+        int64_t startNs;
+        int64_t durationNs;
+        uint64_t bytes;
+    };
+
+    struct Totals
+    {
+        size_t calls = 0;
+        int64_t ns = 0;
+        uint64_t bytes = 0;
+    };
+
+    // Spans kept for the JSON output; later ones are only totalled
+    static constexpr size_t MAX_SPANS = 1000000;
+
+    bool active = false;
+    string jsonPath;
+    chrono::steady_clock::time_point origin = chrono::steady_clock::now();
+    mutex lock;
+    map<string, Totals> totals;
+    map<string, int64_t> counters;
+    vector<Span> spans;
+    size_t droppedSpans = 0;
+
+    static uint32_t threadNumber()
+    {
+        static atomic<uint32_t> next{1};
+        thread_local uint32_t number = next++;
+        return number;
+    }
+
+    static string jsonEscape(const string &text)
+    {
+        string out;
+        for (char c : text)
+        {
+            if (c == '"' || c == '\\')
+                out.push_back('\\');
+            out.push_back(c);
+        }
+        return out;
+    }
+
+    void writeJson()
+    {
+        ofstream out(jsonPath, ios::trunc);
+        out << "{\"traceEvents\":[\n";
+        bool first = true;
+        for (const Span &span : spans)
+        {
+            out << (first ? "" : ",\n") << "{\"name\":\"" << jsonEscape(span.name) << "\",\"ph\":\"X\",\"pid\":1,\"tid\":"
+                << span.thread << ",\"ts\":" << span.startNs / 1000.0 << ",\"dur\":" << span.durationNs / 1000.0;
+            if (span.bytes)
+                out << ",\"args\":{\"bytes\":" << span.bytes << "}";
+            out << "}";
+            first = false;
+        }
+        double endUs = chrono::duration<double, micro>(chrono::steady_clock::now() - origin).count();
+        for (const auto &[name, value] : counters)
+        {
+            out << (first ? "" : ",\n") << "{\"name\":\"" << jsonEscape(name) << "\",\"ph\":\"C\",\"pid\":1,\"ts\":"
+                << endUs << ",\"args\":{\"value\":" << value << "}}";
+            first = false;
+        }
+        out << "\n],\"otherData\":{\"droppedSpans\":" << droppedSpans << "}}\n";
+        if (!out)
+            cerr << "trace: cannot write " << jsonPath << endl;
+    }
+
+    void printSummary()
+    {
+        cerr << left << setw(24) << "operation" << right << setw(10) << "calls" << setw(12) << "total ms"
+             << setw(12) << "avg us" << setw(12) << "MiB" << setw(10) << "MiB/s" << endl;
+        for (const auto &[name, total] : totals)
+        {
+            double ms = total.ns / 1e6;
+            double mib = total.bytes / (1024.0 * 1024.0);
+            cerr << left << setw(24) << name << right << setw(10) << total.calls << fixed << setprecision(3)
+                 << setw(12) << ms << setw(12) << setprecision(1) << total.ns / 1e3 / total.calls;
+            if (total.bytes)
+                cerr << setw(12) << mib << setw(10) << (ms > 0 ? mib / (ms / 1000) : 0.0);
+            cerr << defaultfloat << endl;
+        }
+        for (const auto &[name, value] : counters)
+        {
+            cerr << left << setw(24) << name << right << setw(10) << value << endl;
+        }
+    }
+
+public:
+    Trace()
+    {
+        const char *setting = getenv("MYGIT_TRACE");
+        if (!setting || !*setting || string(setting) == "0")
+            return;
+        active = true;
+        if (string(setting) != "1")
+            jsonPath = setting;
+    }
+
+    ~Trace()
+    {
+        if (!active)
+            return;
+        try
+        {
+            if (jsonPath.empty())
+                printSummary();
+            else
+                writeJson();
+        }
+        catch (...)
+        {
+        }
+    }
+
+    bool enabled() const { return active; }
+
+    void record(const char *name, chrono::steady_clock::time_point start, chrono::steady_clock::time_point end,
+                uint64_t bytes)
+    {
+        int64_t startNs = chrono::duration_cast<chrono::nanoseconds>(start - origin).count();
+        int64_t durationNs = chrono::duration_cast<chrono::nanoseconds>(end - start).count();
+        uint32_t thread = threadNumber();
+        lock_guard<mutex> guard(lock);
+        Totals &total = totals[name];
+        total.calls++;
+        total.ns += durationNs;
+        total.bytes += bytes;
+        if (jsonPath.empty())
+            return;
+        if (spans.size() < MAX_SPANS)
+            spans.push_back({name, thread, startNs, durationNs, bytes});
+        else
+            droppedSpans++;
+    }
+
+    // Adds `delta` to the named counter; a no-op unless tracing is on
+    void count(const char *name, int64_t delta = 1)
+    {
+        if (!active)
+            return;
+        lock_guard<mutex> guard(lock);
+        counters[name] += delta;
+    }
+};
+
+inline Trace tracer;
+
+// Times the enclosing block under `name` when tracing is on; `bytes` feeds the throughput column
+class TraceScope
+{
+    const char *name;
+    uint64_t bytes;
+    bool active;
+    chrono::steady_clock::time_point start;
+
+public:
+    explicit TraceScope(const char *scopeName, uint64_t byteCount = 0)
+        : name(scopeName), bytes(byteCount), active(tracer.enabled())
+    {
+        if (active)
+            start = chrono::steady_clock::now();
+    }
+    TraceScope(const TraceScope &) = delete;
+    TraceScope &operator=(const TraceScope &) = delete;
+    ~TraceScope()
+    {
+        if (active)
+            tracer.record(name, start, chrono::steady_clock::now(), bytes);
+    }
+
+    void addBytes(uint64_t count) { bytes += count; }
+};
+
+// Helper functions for the fixed-width big-endian fields used by the binary on-disk formats
+inline void putBE32(string &out, uint32_t value)
+{
+    for (int shift = 24; shift >= 0; shift -= 8)
+        out.push_back(static_cast<char>((value >> shift) & 0xff));
+}
+
+inline void putBE64(string &out, uint64_t value)
+{
+    putBE32(out, static_cast<uint32_t>(value >> 32));
+    putBE32(out, static_cast<uint32_t>(value));
+}
+
+inline uint32_t getBE32(const unsigned char *data)
+{
+    return (uint32_t(data[0]) << 24) | (uint32_t(data[1]) << 16) | (uint32_t(data[2]) << 8) | uint32_t(data[3]);
+}
+
+inline uint64_t getBE64(const unsigned char *data)
+{
+    return (uint64_t(getBE32(data)) << 32) | getBE32(data + 4);
+}
+
+// Lookup tables for hex conversion: every byte value's two digits, and every digit's value (-1 if
+// not a lowercase or uppercase hex digit)
+struct HexTables
+{
+    char pairs[256][2];
+    int8_t values[256];
+
+    HexTables()
+    {
+        static const char digits[] = "0123456789abcdef";
+        for (int i = 0; i < 256; i++)
+        {
+            pairs[i][0] = digits[i >> 4];
+            pairs[i][1] = digits[i & 0x0f];
+            values[i] = -1;
+        }
+        for (int i = 0; i < 16; i++)
+        {
+            values[static_cast<unsigned char>(digits[i])] = i;
+            values[static_cast<unsigned char>(toupper(digits[i]))] = i;
+        }
+    }
+};
+inline const HexTables hexTables;
+
+// A 20-byte binary object name. In-memory sets and caches key on this; the 40-char hex form is
+// only produced where a path, a text object or output needs it.
+struct ObjectId
+{
+    array<unsigned char, SHA_DIGEST_LENGTH> bytes{};
+
+    static ObjectId fromRaw(const unsigned char *raw)
+    {
+        ObjectId id;
+        memcpy(id.bytes.data(), raw, SHA_DIGEST_LENGTH);
+        return id;
+    }
+
+    // Parses a 40-char hex name; returns false when `hex` is not one
+    static bool parseHex(string_view hex, ObjectId &id)
+    {
+        if (hex.size() != 2 * SHA_DIGEST_LENGTH)
             return false;
+        for (int i = 0; i < SHA_DIGEST_LENGTH; i++)
+        {
+            int high = hexTables.values[static_cast<unsigned char>(hex[2 * i])];
+            int low = hexTables.values[static_cast<unsigned char>(hex[2 * i + 1])];
+            if (high < 0 || low < 0)
+                return false;
+            id.bytes[i] = static_cast<unsigned char>((high << 4) | low);
         }
+        return true;
     }
 
-    // Helper function to compute SHA1 hash
-    string computeSHA1(const string &content)
+    static ObjectId fromHex(string_view hex)
     {
-        unsigned char hash[SHA_DIGEST_LENGTH];
-        SHA_CTX sha1;
-        SHA1_Init(&sha1);
-        SHA1_Update(&sha1, content.c_str(), content.length());
-        SHA1_Final(hash, &sha1);
+        ObjectId id;
+        if (!parseHex(hex, id))
+            throw runtime_error("Invalid object SHA: " + string(hex));
+        return id;
+    }
 
-        stringstream ss;
+    // Writes the 40 hex digits to `out` (no terminator)
+    void toHex(char *out) const
+    {
         for (int i = 0; i < SHA_DIGEST_LENGTH; i++)
         {
-            ss << hex << setw(2) << setfill('0') << (int)hash[i];
+            memcpy(out + 2 * i, hexTables.pairs[bytes[i]], 2);
         }
-        return ss.str();
     }
 
-    // Helper function to compress data
-    string compressData(const string &data)
+    string hex() const
     {
-        z_stream zs;
-        memset(&zs, 0, sizeof(zs));
+        string out(2 * SHA_DIGEST_LENGTH, '\0');
+        toHex(out.data());
+        return out;
+    }
+
+    const unsigned char *data() const { return bytes.data(); }
+
+    bool operator==(const ObjectId &other) const { return bytes == other.bytes; }
+    bool operator!=(const ObjectId &other) const { return bytes != other.bytes; }
+    bool operator<(const ObjectId &other) const { return bytes < other.bytes; }
+};
+
+// SHA-1 output is uniformly distributed, so its first bytes already make a good hash
+struct ObjectIdHash
+{
+    size_t operator()(const ObjectId &id) const
+    {
+        size_t value;
+        memcpy(&value, id.bytes.data(), sizeof(value));
+        return value;
+    }
+};
+
+// Helper functions to convert between 40-char hex SHAs and their 20-byte raw form
+inline string hexToRaw(const string &hexSha)
+{
+    ObjectId id = ObjectId::fromHex(hexSha);
+    return string(reinterpret_cast<const char *>(id.data()), SHA_DIGEST_LENGTH);
+}
+
+inline string rawToHex(const unsigned char *raw)
+{
+    return ObjectId::fromRaw(raw).hex();
+}
+
+// Incremental SHA-1 through OpenSSL's EVP interface, which dispatches at runtime to the fastest
+// implementation the CPU supports (SHA-NI, AVX2, ...). The digest is fetched once per process
+// and each thread reuses one context for one-shot hashes.
+class Sha1
+{
+    EVP_MD_CTX *ctx;
 
-        if (deflateInit(&zs, Z_BEST_COMPRESSION) != Z_OK)
+    static const EVP_MD *algorithm()
+    {
+        static const EVP_MD *md = EVP_MD_fetch(nullptr, "SHA1", nullptr);
+        if (!md)
+            throw runtime_error("SHA-1 is not available from OpenSSL");
+        return md;
+    }
+
+public:
+    Sha1() : ctx(EVP_MD_CTX_new())
+    {
+        if (!ctx || EVP_DigestInit_ex(ctx, algorithm(), nullptr) != 1)
         {
-            throw runtime_error("deflateInit failed");
+            EVP_MD_CTX_free(ctx);
+            throw runtime_error("Cannot initialise SHA-1");
         }
+    }
+    Sha1(const Sha1 &) = delete;
+    Sha1 &operator=(const Sha1 &) = delete;
+    ~Sha1() { EVP_MD_CTX_free(ctx); }
 
-        zs.next_in = (Bytef *)data.data();
-        zs.avail_in = data.size();
+    void update(const void *data, size_t length)
+    {
+        TraceScope trace("sha1", length);
+        if (EVP_DigestUpdate(ctx, data, length) != 1)
+            throw runtime_error("SHA-1 update failed");
+    }
 
-        int ret;
-        char outbuffer[32768];
-        string compressed;
+    // Returns the digest and resets the context for the next input
+    ObjectId finish()
+    {
+        ObjectId id;
+        if (EVP_DigestFinal_ex(ctx, id.bytes.data(), nullptr) != 1 || EVP_DigestInit_ex(ctx, algorithm(), nullptr) != 1)
+            throw runtime_error("SHA-1 final failed");
+        return id;
+    }
 
-        do
+    static ObjectId hash(const void *data, size_t length)
+    {
+        thread_local Sha1 hasher;
+        hasher.update(data, length);
+        return hasher.finish();
+    }
+
+    static ObjectId hash(string_view data)
+    {
+        return hash(data.data(), data.size());
+    }
+};
+
+// One staged path together with the stat data captured when it was hashed
+struct IndexEntry
+{
+    string path;
+    string sha; // 40-char hex
+    uint32_t mode = 0100644;
+    uint64_t size = 0;
+    int64_t mtimeSec = 0;
+    uint32_t mtimeNsec = 0;
+    int64_t ctimeSec = 0;
+    uint32_t ctimeNsec = 0;
+    uint64_t ino = 0;
+
+    void setStat(const struct stat &st)
+    {
+        size = st.st_size;
+        mtimeSec = st.st_mtim.tv_sec;
+        mtimeNsec = st.st_mtim.tv_nsec;
+        ctimeSec = st.st_ctim.tv_sec;
+        ctimeNsec = st.st_ctim.tv_nsec;
+        ino = st.st_ino;
+    }
+};
+
+// Binary index (.mygit/index), version 1:
+//
+//   header    "MGIX" | version u32 | entry count u32 | path table size u32
+//   entries   count fixed-width records sorted by path (see ENTRY_SIZE)
+//   paths     NUL-terminated paths referenced by (offset, length) from each record
+//   ext       zero or more extensions: signature[4] | size u32 | data
+//   trailer   SHA1 of everything above
+//
+// Fixed-width records let lookups binary search the mmapped file directly
+// instead of parsing every entry.
+class IndexFile
+{
+private:
+    static constexpr char MAGIC[4] = {'M', 'G', 'I', 'X'};
+    static constexpr uint32_t VERSION = 1;
+    static constexpr size_t HEADER_SIZE = 16;
+    // ctime s/ns, mtime s/ns, ino, mode, size, sha, path offset, path length
+    static constexpr size_t ENTRY_SIZE = 8 + 4 + 8 + 4 + 8 + 4 + 8 + SHA_DIGEST_LENGTH + 4 + 4;
+
+    const unsigned char *data = nullptr;
+    size_t length = 0;
+    uint32_t count = 0;
+    const unsigned char *records = nullptr;
+    const unsigned char *paths = nullptr;
+    uint32_t pathTableSize = 0;
+    map<string, string> extensionData;
+    vector<IndexEntry> legacyEntries; // Entries parsed from a pre-binary text index
+    struct timespec fileMtime = {0, 0};
+
+    const unsigned char *record(size_t i) const
+    {
+        return records + i * ENTRY_SIZE;
+    }
+
+    void loadLegacyText(const string &text)
+    {
+        // Old format: one "mode sha path" line per add, later lines win
+        map<string, IndexEntry> latest;
+        istringstream stream(text);
+        string line;
+        while (getline(stream, line))
+        {
+            istringstream iss(line);
+            IndexEntry entry;
+            string mode;
+            if (!(iss >> mode >> entry.sha >> entry.path))
+                continue;
+            entry.mode = stoul(mode, nullptr, 8);
+            latest[entry.path] = entry;
+        }
+        for (auto &[path, entry] : latest)
+            legacyEntries.push_back(entry);
+        count = legacyEntries.size();
+    }
+
+    void unmap()
+    {
+        if (data)
+            munmap(const_cast<unsigned char *>(data), length);
+        data = nullptr;
+        length = 0;
+    }
+
+public:
+    IndexFile() = default;
+    IndexFile(const IndexFile &) = delete;
+    IndexFile &operator=(const IndexFile &) = delete;
+    ~IndexFile() { unmap(); }
+
+    // Maps the index at `indexPath`; a missing file is an empty index
+    void load(const string &indexPath)
+    {
+        TraceScope trace("index.load");
+        unmap();
+        count = 0;
+        legacyEntries.clear();
+        extensionData.clear();
+        fileMtime = {0, 0};
+
+        int fd = open(indexPath.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            if (errno == ENOENT)
+                return;
+            throw runtime_error("Cannot open index: " + indexPath);
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0)
+        {
+            close(fd);
+            throw runtime_error("Cannot stat index: " + indexPath);
+        }
+        fileMtime = st.st_mtim;
+        if (st.st_size == 0)
+        {
+            close(fd);
+            return;
+        }
+        void *mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (mapped == MAP_FAILED)
         {
-            zs.next_out = reinterpret_cast<Bytef *>(outbuffer);
-            zs.avail_out = sizeof(outbuffer);
+            throw runtime_error("Cannot mmap index: " + indexPath);
+        }
+        data = static_cast<const unsigned char *>(mapped);
+        length = st.st_size;
 
-            ret = deflate(&zs, Z_FINISH);
+        if (length < 4 || memcmp(data, MAGIC, 4) != 0)
+        {
+            loadLegacyText(string(reinterpret_cast<const char *>(data), length));
+            unmap();
+            return;
+        }
 
-            if (compressed.size() < zs.total_out)
-            {
-                compressed.append(outbuffer, zs.total_out - compressed.size());
+        if (length < HEADER_SIZE + SHA_DIGEST_LENGTH || getBE32(data + 4) != VERSION)
+        {
+            throw runtime_error("Unsupported or corrupt index file");
+        }
+        count = getBE32(data + 8);
+        pathTableSize = getBE32(data + 12);
+        size_t extStart = HEADER_SIZE + size_t(count) * ENTRY_SIZE + pathTableSize;
+        if (extStart + SHA_DIGEST_LENGTH > length)
+        {
+            throw runtime_error("Corrupt index file: truncated");
+        }
+        size_t body = length - SHA_DIGEST_LENGTH;
+        if (memcmp(Sha1::hash(data, body).data(), data + body, SHA_DIGEST_LENGTH) != 0)
+        {
+            throw runtime_error("Corrupt index file: checksum mismatch");
+        }
+        records = data + HEADER_SIZE;
+        paths = records + size_t(count) * ENTRY_SIZE;
+        // Paths are read in place later, so every entry must point inside the path table
+        for (size_t i = 0; i < count; i++)
+        {
+            const unsigned char *rec = record(i);
+            if (uint64_t(getBE32(rec + ENTRY_SIZE - 8)) + getBE32(rec + ENTRY_SIZE - 4) > pathTableSize)
+                throw runtime_error("Corrupt index file: path of entry " + to_string(i) + " is out of bounds");
+        }
+
+        size_t pos = extStart;
+        size_t extEnd = length - SHA_DIGEST_LENGTH;
+        while (pos + 8 <= extEnd)
+        {
+            string signature(reinterpret_cast<const char *>(data + pos), 4);
+            uint32_t extSize = getBE32(data + pos + 4);
+            if (pos + 8 + extSize > extEnd)
+                throw runtime_error("Corrupt index file: bad extension " + signature);
+            extensionData[signature] = string(reinterpret_cast<const char *>(data + pos + 8), extSize);
+            pos += 8 + extSize;
+        }
+    }
+
+    size_t size() const { return count; }
+
+    // True when the file behind `st` is known to still match `entry` without reading it.
+    // Entries modified in the same timestamp granule the index was written in are "racy":
+    // a later edit could keep the same mtime and size, so those always get rehashed.
+    bool isUpToDate(const IndexEntry &entry, const struct stat &st) const
+    {
+        if (uint64_t(st.st_size) != entry.size || st.st_ino != entry.ino ||
+            st.st_mtim.tv_sec != entry.mtimeSec || uint32_t(st.st_mtim.tv_nsec) != entry.mtimeNsec ||
+            st.st_ctim.tv_sec != entry.ctimeSec || uint32_t(st.st_ctim.tv_nsec) != entry.ctimeNsec)
+        {
+            return false;
+        }
+        return entry.mtimeSec < fileMtime.tv_sec ||
+               (entry.mtimeSec == fileMtime.tv_sec && entry.mtimeNsec < uint32_t(fileMtime.tv_nsec));
+    }
+
+    // Path of entry i, read in place from the path table
+    string_view pathView(size_t i) const
+    {
+        if (!data)
+            return legacyEntries[i].path;
+        const unsigned char *rec = record(i);
+        uint32_t offset = getBE32(rec + ENTRY_SIZE - 8);
+        uint32_t pathLength = getBE32(rec + ENTRY_SIZE - 4);
+        return string_view(reinterpret_cast<const char *>(paths + offset), pathLength);
+    }
+
+    string pathAt(size_t i) const
+    {
+        return string(pathView(i));
+    }
+
+    IndexEntry entryAt(size_t i) const
+    {
+        if (!data)
+            return legacyEntries[i];
+        const unsigned char *rec = record(i);
+        IndexEntry entry;
+        entry.ctimeSec = static_cast<int64_t>(getBE64(rec));
+        entry.ctimeNsec = getBE32(rec + 8);
+        entry.mtimeSec = static_cast<int64_t>(getBE64(rec + 12));
+        entry.mtimeNsec = getBE32(rec + 20);
+        entry.ino = getBE64(rec + 24);
+        entry.mode = getBE32(rec + 32);
+        entry.size = getBE64(rec + 36);
+        entry.sha = rawToHex(rec + 44);
+        entry.path = pathAt(i);
+        return entry;
+    }
+
+    static constexpr size_t npos = size_t(-1);
+
+    // Binary search for the first entry whose path is not less than `path`
+    size_t lowerBound(string_view path) const
+    {
+        size_t lo = 0, hi = count;
+        while (lo < hi)
+        {
+            size_t mid = lo + (hi - lo) / 2;
+            if (pathView(mid) < path)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        return lo;
+    }
+
+    // Position of `path` in the index, or npos when it is not staged
+    size_t indexOf(string_view path) const
+    {
+        size_t pos = lowerBound(path);
+        return pos < count && pathView(pos) == path ? pos : npos;
+    }
+
+    // Binary search for `path`; returns false when it is not staged
+    bool find(const string &path, IndexEntry &entry) const
+    {
+        size_t pos = indexOf(path);
+        if (pos == npos)
+            return false;
+        entry = entryAt(pos);
+        return true;
+    }
+
+    vector<IndexEntry> entries() const
+    {
+        vector<IndexEntry> all;
+        all.reserve(count);
+        for (size_t i = 0; i < count; i++)
+            all.push_back(entryAt(i));
+        return all;
+    }
+
+    // Raw payload of an extension section, empty when absent
+    string extension(const string &signature) const
+    {
+        auto it = extensionData.find(signature);
+        return it == extensionData.end() ? "" : it->second;
+    }
+
+    // Writes `entries` (any order, unique paths) to `indexPath` through a lock file that is
+    // renamed over the old index, so readers never observe a partially written index
+    static void write(const string &indexPath, vector<IndexEntry> entries, const map<string, string> &extensions = {})
+    {
+        TraceScope trace("index.write");
+        sort(entries.begin(), entries.end(), [](const IndexEntry &a, const IndexEntry &b)
+             { return a.path < b.path; });
+
+        string out;
+        string pathTable;
+        out.reserve(HEADER_SIZE + entries.size() * ENTRY_SIZE);
+        out.append(MAGIC, 4);
+        putBE32(out, VERSION);
+        putBE32(out, entries.size());
+        size_t sizeField = out.size();
+        putBE32(out, 0); // path table size, patched below
+
+        for (const IndexEntry &entry : entries)
+        {
+            putBE64(out, static_cast<uint64_t>(entry.ctimeSec));
+            putBE32(out, entry.ctimeNsec);
+            putBE64(out, static_cast<uint64_t>(entry.mtimeSec));
+            putBE32(out, entry.mtimeNsec);
+            putBE64(out, entry.ino);
+            putBE32(out, entry.mode);
+            putBE64(out, entry.size);
+            out += hexToRaw(entry.sha);
+            putBE32(out, pathTable.size());
+            putBE32(out, entry.path.size());
+            pathTable += entry.path;
+            pathTable.push_back('\0');
+        }
+        string tableSize;
+        putBE32(tableSize, pathTable.size());
+        out.replace(sizeField, 4, tableSize);
+        out += pathTable;
+
+        for (const auto &[signature, payload] : extensions)
+        {
+            out.append(signature, 0, 4);
+            putBE32(out, payload.size());
+            out += payload;
+        }
+
+        ObjectId checksum = Sha1::hash(out);
+        out.append(reinterpret_cast<const char *>(checksum.data()), SHA_DIGEST_LENGTH);
+
+        string lockPath = indexPath + ".lock";
+        int fd = open(lockPath.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+        if (fd < 0)
+        {
+            throw runtime_error("Unable to create " + lockPath + ": another mygit process may be running");
+        }
+        const char *cursor = out.data();
+        size_t remaining = out.size();
+        while (remaining > 0)
+        {
+            ssize_t written = ::write(fd, cursor, remaining);
+            if (written < 0 && errno == EINTR)
+                continue;
+            if (written < 0)
+            {
+                close(fd);
+                unlink(lockPath.c_str());
+                throw runtime_error("Cannot write " + lockPath);
+            }
+            cursor += written;
+            remaining -= written;
+        }
+        if (close(fd) != 0 || rename(lockPath.c_str(), indexPath.c_str()) != 0)
+        {
+            unlink(lockPath.c_str());
+            throw runtime_error("Cannot update index");
+        }
+    }
+};
+
+// Repository settings from .mygit/config, in git's INI style:
+//
+//   [compression]
+//       level = 6
+//       blob = 1
+//
+// Keys are looked up as "section.key", case-insensitively; '#' and ';' start comments.
+class Config
+{
+private:
+    map<string, string> values;
+
+    static string trim(const string &text)
+    {
+        size_t first = text.find_first_not_of(" \t\r");
+        if (first == string::npos)
+            return "";
+        size_t last = text.find_last_not_of(" \t\r");
+        return text.substr(first, last - first + 1);
+    }
+
+    static string lower(string text)
+    {
+        transform(text.begin(), text.end(), text.begin(), [](unsigned char c)
+                  { return tolower(c); });
+        return text;
+    }
+
+public:
+    void load(const string &path)
+    {
+        values.clear();
+        ifstream file(path);
+        string line, section;
+        while (getline(file, line))
+        {
+            size_t comment = line.find_first_of("#;");
+            if (comment != string::npos)
+                line = line.substr(0, comment);
+            line = trim(line);
+            if (line.empty())
+                continue;
+            if (line.front() == '[' && line.back() == ']')
+            {
+                section = lower(trim(line.substr(1, line.size() - 2)));
+                continue;
+            }
+            size_t equals = line.find('=');
+            if (equals == string::npos)
+                continue;
+            values[section + "." + lower(trim(line.substr(0, equals)))] = trim(line.substr(equals + 1));
+        }
+    }
+
+    string get(const string &key, const string &fallback = "") const
+    {
+        auto it = values.find(lower(key));
+        return it == values.end() ? fallback : it->second;
+    }
+
+    long long getInt(const string &key, long long fallback) const
+    {
+        string value = get(key);
+        if (value.empty())
+            return fallback;
+        try
+        {
+            size_t used;
+            long long number = stoll(value, &used);
+            // Accept k/m/g suffixes for sizes
+            switch (used < value.size() ? tolower(value[used]) : 0)
+            {
+            case 'g':
+                number *= 1024;
+                [[fallthrough]];
+            case 'm':
+                number *= 1024;
+                [[fallthrough]];
+            case 'k':
+                number *= 1024;
+            }
+            return number;
+        }
+        catch (const exception &)
+        {
+            throw runtime_error("Invalid number for config key " + key + ": " + value);
+        }
+    }
+
+    bool getBool(const string &key, bool fallback) const
+    {
+        string value = lower(get(key));
+        if (value.empty())
+            return fallback;
+        return value == "true" || value == "yes" || value == "on" || value == "1";
+    }
+};
+
+// Incremental compressor for object data. zlib is the default; zstd is available when built with
+// ZSTD=1 (MYGIT_WITH_ZSTD). Readers tell the two apart by the zstd frame magic, so objects written
+// with either codec can be mixed in one repository.
+class ObjectCompressor
+{
+private:
+    bool useZstd = false;
+    z_stream zs;
+#ifdef MYGIT_WITH_ZSTD
+    ZSTD_CCtx *cctx = nullptr;
+#endif
+    vector<char> outbuffer;
+
+    void run(const char *data, size_t length, bool finish, const function<void(const char *, size_t)> &sink)
+    {
+        TraceScope trace("deflate", length);
+#ifdef MYGIT_WITH_ZSTD
+        if (useZstd)
+        {
+            ZSTD_inBuffer input = {data, length, 0};
+            size_t remaining;
+            do
+            {
+                ZSTD_outBuffer output = {outbuffer.data(), outbuffer.size(), 0};
+                remaining = ZSTD_compressStream2(cctx, &output, &input, finish ? ZSTD_e_end : ZSTD_e_continue);
+                if (ZSTD_isError(remaining))
+                    throw runtime_error(string("zstd compression failed: ") + ZSTD_getErrorName(remaining));
+                sink(outbuffer.data(), output.pos);
+            } while (finish ? remaining != 0 : input.pos < input.size);
+            return;
+        }
+#endif
+        zs.next_in = (Bytef *)data;
+        zs.avail_in = length;
+        int flush = finish ? Z_FINISH : Z_NO_FLUSH;
+        int ret;
+        do
+        {
+            zs.next_out = reinterpret_cast<Bytef *>(outbuffer.data());
+            zs.avail_out = outbuffer.size();
+            ret = deflate(&zs, flush);
+            if (ret == Z_STREAM_ERROR)
+            {
+                throw runtime_error("deflate failed");
+            }
+            sink(outbuffer.data(), outbuffer.size() - zs.avail_out);
+        } while (zs.avail_out == 0 || (finish && ret != Z_STREAM_END));
+    }
+
+public:
+    ObjectCompressor(const string &codec, int level) : outbuffer(64 * 1024)
+    {
+        memset(&zs, 0, sizeof(zs));
+        if (codec == "zstd")
+        {
+#ifdef MYGIT_WITH_ZSTD
+            useZstd = true;
+            cctx = ZSTD_createCCtx();
+            if (!cctx)
+                throw runtime_error("ZSTD_createCCtx failed");
+            ZSTD_CCtx_setParameter(cctx, ZSTD_c_compressionLevel, level);
+            return;
+#else
+            throw runtime_error("compression.codec is zstd but mygit was built without zstd support (rebuild with ZSTD=1)");
+#endif
+        }
+        if (codec != "zlib")
+        {
+            throw runtime_error("Unknown compression.codec: " + codec);
+        }
+        if (deflateInit(&zs, level) != Z_OK)
+        {
+            throw runtime_error("deflateInit failed");
+        }
+    }
+    ObjectCompressor(const ObjectCompressor &) = delete;
+    ObjectCompressor &operator=(const ObjectCompressor &) = delete;
+    ~ObjectCompressor()
+    {
+#ifdef MYGIT_WITH_ZSTD
+        if (cctx)
+            ZSTD_freeCCtx(cctx);
+#endif
+        if (!useZstd)
+            deflateEnd(&zs);
+    }
+
+    void update(const char *data, size_t length, const function<void(const char *, size_t)> &sink)
+    {
+        run(data, length, false, sink);
+    }
+
+    void finish(const function<void(const char *, size_t)> &sink)
+    {
+        run(nullptr, 0, true, sink);
+    }
+
+    // True when `data` starts with a zstd frame rather than a zlib stream
+    static bool isZstdFrame(const unsigned char *data, size_t length)
+    {
+        return length >= 4 && data[0] == 0x28 && data[1] == 0xb5 && data[2] == 0x2f && data[3] == 0xfd;
+    }
+};
+
+// Bounded LRU cache of inflated objects keyed by SHA, shared by every reader in the process.
+// Capacity counts content bytes; objects bigger than a quarter of it are not cached so one
+// large blob cannot flush everything else.
+class ObjectCache
+{
+public:
+    struct Entry
+    {
+        string type;
+        string content;
+    };
+
+    using Stats = ObjectCacheStats;
+
+private:
+    size_t capacity;
+    list<ObjectId> order; // most recently used at the front
+    unordered_map<ObjectId, pair<shared_ptr<const Entry>, list<ObjectId>::iterator>, ObjectIdHash> entries;
+    Stats counters;
+    mutable mutex lock;
+
+    void evictTo(size_t limit)
+    {
+        while (counters.bytes > limit && !order.empty())
+        {
+            auto it = entries.find(order.back());
+            counters.bytes -= it->second.first->content.size();
+            entries.erase(it);
+            order.pop_back();
+            counters.evictions++;
+        }
+    }
+
+public:
+    explicit ObjectCache(size_t capacityBytes) : capacity(capacityBytes) {}
+
+    void setCapacity(size_t capacityBytes)
+    {
+        lock_guard<mutex> guard(lock);
+        capacity = capacityBytes;
+        evictTo(capacity);
+    }
+
+    shared_ptr<const Entry> get(const ObjectId &sha)
+    {
+        lock_guard<mutex> guard(lock);
+        auto it = entries.find(sha);
+        if (it == entries.end())
+        {
+            counters.misses++;
+            return nullptr;
+        }
+        counters.hits++;
+        order.splice(order.begin(), order, it->second.second);
+        return it->second.first;
+    }
+
+    void put(const ObjectId &sha, shared_ptr<const Entry> entry)
+    {
+        lock_guard<mutex> guard(lock);
+        if (entry->content.size() > capacity / 4 || entries.count(sha))
+            return;
+        order.push_front(sha);
+        counters.bytes += entry->content.size();
+        entries[sha] = {move(entry), order.begin()};
+        evictTo(capacity);
+    }
+
+    Stats stats() const
+    {
+        lock_guard<mutex> guard(lock);
+        Stats snapshot = counters;
+        snapshot.entries = entries.size();
+        return snapshot;
+    }
+};
+
+// Read-only view of an inflated object. It shares the buffer held by the object cache, so
+// copying a view or reading its content never copies the object itself.
+class ObjectView
+{
+    shared_ptr<const ObjectCache::Entry> entry;
+
+public:
+    explicit ObjectView(shared_ptr<const ObjectCache::Entry> object) : entry(move(object)) {}
+
+    const string &type() const { return entry->type; }
+    size_t size() const { return entry->content.size(); }
+    const char *data() const { return entry->content.data(); }
+    string_view content() const { return entry->content; }
+    // The shared buffer, for callers that keep the content beyond the view's lifetime
+    shared_ptr<const ObjectCache::Entry> buffer() const { return entry; }
+};
+
+// Helper function to split the next '\n'-terminated line off the front of `rest`; false at the end
+inline bool nextLine(string_view &rest, string_view &line)
+{
+    if (rest.empty())
+        return false;
+    size_t newline = rest.find('\n');
+    line = rest.substr(0, newline);
+    rest = newline == string_view::npos ? string_view() : rest.substr(newline + 1);
+    return true;
+}
+
+// Helper functions for the little-endian base-128 sizes used in delta headers
+inline void putVarint(string &out, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        out.push_back(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+inline uint64_t getVarint(const unsigned char *&cursor, const unsigned char *end)
+{
+    uint64_t value = 0;
+    int shift = 0;
+    while (cursor < end)
+    {
+        unsigned char c = *cursor++;
+        value |= uint64_t(c & 0x7f) << shift;
+        if (!(c & 0x80))
+            return value;
+        shift += 7;
+    }
+    throw runtime_error("Corrupt delta: truncated size");
+}
+
+// Delta encoding between two versions of an object, in the same spirit as git's pack deltas:
+//
+//   base size (varint) | target size (varint) | instructions
+//
+// An instruction byte with the high bit set copies a range of the base (the low 4 bits flag
+// which offset bytes follow, the next 3 bits which size bytes follow); otherwise the byte is
+// a literal length of 1-127 and that many bytes of new data follow.
+class Delta
+{
+private:
+    static constexpr size_t BLOCK = 16;
+    static constexpr uint32_t MULTIPLIER = 257;
+
+    static uint32_t hashBlock(const unsigned char *data)
+    {
+        uint32_t h = 0;
+        for (size_t i = 0; i < BLOCK; i++)
+            h = h * MULTIPLIER + data[i];
+        return h;
+    }
+
+    static void flushLiteral(string &out, const unsigned char *data, size_t length)
+    {
+        while (length > 0)
+        {
+            size_t chunk = min<size_t>(length, 127);
+            out.push_back(static_cast<char>(chunk));
+            out.append(reinterpret_cast<const char *>(data), chunk);
+            data += chunk;
+            length -= chunk;
+        }
+    }
+
+    static void emitCopy(string &out, uint64_t offset, uint64_t size)
+    {
+        while (size > 0)
+        {
+            uint64_t chunk = min<uint64_t>(size, 0xffffff);
+            unsigned char cmd = 0x80;
+            string args;
+            for (int i = 0; i < 4; i++)
+            {
+                unsigned char byte = (offset >> (8 * i)) & 0xff;
+                if (byte)
+                {
+                    cmd |= 1 << i;
+                    args.push_back(static_cast<char>(byte));
+                }
+            }
+            for (int i = 0; i < 3; i++)
+            {
+                unsigned char byte = (chunk >> (8 * i)) & 0xff;
+                if (byte)
+                {
+                    cmd |= 0x10 << i;
+                    args.push_back(static_cast<char>(byte));
+                }
+            }
+            out.push_back(static_cast<char>(cmd));
+            out += args;
+            offset += chunk;
+            size -= chunk;
+        }
+    }
+
+public:
+    // Builds a delta that turns `base` into `target`. Base blocks are indexed every BLOCK bytes
+    // and a rolling hash over the target finds candidate matches, which are then extended.
+    static string create(string_view base, string_view target)
+    {
+        string out;
+        putVarint(out, base.size());
+        putVarint(out, target.size());
+
+        const unsigned char *src = reinterpret_cast<const unsigned char *>(base.data());
+        const unsigned char *dst = reinterpret_cast<const unsigned char *>(target.data());
+        size_t srcSize = base.size(), dstSize = target.size();
+
+        if (srcSize < BLOCK || dstSize < BLOCK || srcSize > 0xffffffffu)
+        {
+            flushLiteral(out, dst, dstSize);
+            return out;
+        }
+
+        unordered_map<uint32_t, uint32_t> blocks;
+        blocks.reserve(srcSize / BLOCK + 1);
+        for (size_t i = 0; i + BLOCK <= srcSize; i += BLOCK)
+            blocks.emplace(hashBlock(src + i), i);
+
+        uint32_t topPower = 1; // MULTIPLIER^(BLOCK-1), to drop the outgoing byte
+        for (size_t i = 1; i < BLOCK; i++)
+            topPower *= MULTIPLIER;
+
+        size_t literalStart = 0;
+        size_t pos = 0;
+        uint32_t h = hashBlock(dst);
+        while (pos + BLOCK <= dstSize)
+        {
+            auto it = blocks.find(h);
+            if (it != blocks.end() && memcmp(src + it->second, dst + pos, BLOCK) == 0)
+            {
+                size_t srcPos = it->second;
+                size_t length = BLOCK;
+                while (srcPos + length < srcSize && pos + length < dstSize && src[srcPos + length] == dst[pos + length])
+                    length++;
+                // Grow the match backwards over bytes we were about to emit as literals
+                while (srcPos > 0 && pos > literalStart && src[srcPos - 1] == dst[pos - 1])
+                {
+                    srcPos--;
+                    pos--;
+                    length++;
+                }
+                flushLiteral(out, dst + literalStart, pos - literalStart);
+                emitCopy(out, srcPos, length);
+                pos += length;
+                literalStart = pos;
+                if (pos + BLOCK <= dstSize)
+                    h = hashBlock(dst + pos);
+                continue;
+            }
+            if (pos + BLOCK < dstSize)
+                h = (h - dst[pos] * topPower) * MULTIPLIER + dst[pos + BLOCK];
+            pos++;
+        }
+        flushLiteral(out, dst + literalStart, dstSize - literalStart);
+        return out;
+    }
+
+    static string apply(const string &base, const unsigned char *delta, size_t deltaSize)
+    {
+        const unsigned char *cursor = delta;
+        const unsigned char *end = delta + deltaSize;
+        if (getVarint(cursor, end) != base.size())
+            throw runtime_error("Corrupt delta: base size mismatch");
+        uint64_t targetSize = getVarint(cursor, end);
+
+        string target;
+        target.reserve(targetSize);
+        while (cursor < end)
+        {
+            unsigned char cmd = *cursor++;
+            if (cmd & 0x80)
+            {
+                uint64_t offset = 0, size = 0;
+                for (int i = 0; i < 4; i++)
+                    if (cmd & (1 << i))
+                    {
+                        if (cursor >= end)
+                            throw runtime_error("Corrupt delta: truncated copy");
+                        offset |= uint64_t(*cursor++) << (8 * i);
+                    }
+                for (int i = 0; i < 3; i++)
+                    if (cmd & (0x10 << i))
+                    {
+                        if (cursor >= end)
+                            throw runtime_error("Corrupt delta: truncated copy");
+                        size |= uint64_t(*cursor++) << (8 * i);
+                    }
+                if (size == 0)
+                    size = 0x10000;
+                if (offset + size > base.size())
+                    throw runtime_error("Corrupt delta: copy out of range");
+                target.append(base, offset, size);
+            }
+            else if (cmd > 0)
+            {
+                if (cursor + cmd > end)
+                    throw runtime_error("Corrupt delta: truncated literal");
+                target.append(reinterpret_cast<const char *>(cursor), cmd);
+                cursor += cmd;
+            }
+            else
+            {
+                throw runtime_error("Corrupt delta: reserved instruction");
+            }
+        }
+        if (target.size() != targetSize)
+            throw runtime_error("Corrupt delta: result size mismatch");
+        return target;
+    }
+};
+
+// FastCDC content-defined chunking: a gear rolling hash picks cut points from the content itself,
+// so an edit only changes the chunks around it and the rest of a large file keeps its chunk IDs.
+// Normalized chunking uses a stricter mask before the average size and a looser one after it,
+// which keeps chunk sizes close to the average. Cut points never fall before `minSize` or after
+// `maxSize` bytes.
+class ContentChunker
+{
+    size_t minSize;
+    size_t avgSize;
+    size_t maxSize;
+    uint64_t strictMask;
+    uint64_t looseMask;
+
+    // 256 fixed pseudo-random values (splitmix64), identical in every build so chunk IDs are stable
+    static const array<uint64_t, 256> &gear()
+    {
+        static const array<uint64_t, 256> table = []
+        {
+            array<uint64_t, 256> values;
+            uint64_t state = 0x6d79676974636463ULL;
+            for (uint64_t &value : values)
+            {
+                uint64_t z = (state += 0x9e3779b97f4a7c15ULL);
+                z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+                z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+                value = z ^ (z >> 31);
+            }
+            return values;
+        }();
+        return table;
+    }
+
+    // The hash shifts left, so its top bits depend on the last 64 bytes; masks test those bits
+    static uint64_t topBits(unsigned count)
+    {
+        return count == 0 ? 0 : ~0ULL << (64 - count);
+    }
+
+public:
+    explicit ContentChunker(size_t average)
+    {
+        unsigned bits = 0;
+        while ((size_t(1) << (bits + 1)) <= max<size_t>(average, 256))
+            bits++;
+        avgSize = size_t(1) << bits;
+        minSize = avgSize / 4;
+        maxSize = avgSize * 8;
+        strictMask = topBits(bits + 2);
+        looseMask = topBits(bits - 2);
+    }
+
+    size_t maxChunkSize() const { return maxSize; }
+
+    // Length of the chunk starting at `data`. `length` is everything available; unless it is
+    // the end of the input it should hold at least maxChunkSize() bytes.
+    size_t cut(const unsigned char *data, size_t length) const
+    {
+        if (length <= minSize)
+            return length;
+        const array<uint64_t, 256> &table = gear();
+        size_t end = min(length, maxSize);
+        size_t normal = min(end, avgSize);
+        uint64_t hash = 0;
+        size_t i = minSize;
+        for (; i < normal; i++)
+        {
+            hash = (hash << 1) + table[data[i]];
+            if (!(hash & strictMask))
+                return i + 1;
+        }
+        for (; i < end; i++)
+        {
+            hash = (hash << 1) + table[data[i]];
+            if (!(hash & looseMask))
+                return i + 1;
+        }
+        return end;
+    }
+};
+
+// Line-level diff with unified output. Lines keep their '\n', so a missing final newline counts
+// as a change. Before the diff proper:
+//   - the common prefix and suffix are trimmed with plain comparisons (an appended-to log never
+//     gets past this step);
+//   - the remaining lines are interned to integer IDs, so each line is hashed once and later
+//     comparisons are integer compares;
+//   - lines that occur on only one side are marked changed straight away, as xdiff does, which
+//     leaves Myers' algorithm a far shorter sequence.
+// Myers runs in linear space: each step finds the middle snake of the O(ND) search from both
+// ends and recurses on the halves. Past a cost limit (about the square root of the input) it
+// splits at the furthest point reached instead, trading a minimal diff for bounded time.
+class LineDiff
+{
+    const vector<string_view> &oldLines;
+    const vector<string_view> &newLines;
+    vector<char> removed; // per old line
+    vector<char> added;   // per new line
+
+    // Sequences handed to Myers: line IDs and the line numbers they came from
+    vector<uint32_t> seqA, seqB;
+    vector<uint32_t> posA, posB;
+    int maxCost = 0;
+
+    static constexpr size_t HUNK_BUFFER = 64 * 1024;
+
+    // Open-addressing table from line content to a dense ID
+    class Interner
+    {
+        vector<uint32_t> slots; // 0 = empty, otherwise ID + 1
+        vector<string_view> texts;
+        vector<size_t> hashes;
+        size_t mask;
+
+    public:
+        explicit Interner(size_t lines)
+        {
+            size_t capacity = 16;
+            while (capacity < lines * 2)
+                capacity *= 2;
+            slots.assign(capacity, 0);
+            mask = capacity - 1;
+        }
+
+        size_t size() const { return texts.size(); }
+
+        uint32_t intern(string_view line)
+        {
+            size_t hash = std::hash<string_view>()(line);
+            for (size_t i = hash & mask;; i = (i + 1) & mask)
+            {
+                if (slots[i] == 0)
+                {
+                    texts.push_back(line);
+                    hashes.push_back(hash);
+                    slots[i] = texts.size();
+                    return texts.size() - 1;
+                }
+                uint32_t id = slots[i] - 1;
+                if (hashes[id] == hash && texts[id] == line)
+                    return id;
+            }
+        }
+    };
+
+    void markRange(size_t aLo, size_t aHi, size_t bLo, size_t bHi)
+    {
+        for (size_t i = aLo; i < aHi; i++)
+            removed[posA[i]] = 1;
+        for (size_t j = bLo; j < bHi; j++)
+            added[posB[j]] = 1;
+    }
+
+    // Finds a point on (or, past the cost limit, near) an optimal edit path through
+    // seqA[aLo, aHi) x seqB[bLo, bHi), relative to (aLo, bLo). Both ends must differ.
+    pair<int, int> bisect(size_t aLo, size_t aHi, size_t bLo, size_t bHi) const
+    {
+        const uint32_t *a = seqA.data() + aLo, *b = seqB.data() + bLo;
+        int n = aHi - aLo, m = bHi - bLo;
+        int maxD = (n + m + 1) / 2;
+        int offset = maxD, length = 2 * maxD + 2;
+        vector<int> forward(length, -1), backward(length, -1);
+        forward[offset + 1] = 0;
+        backward[offset + 1] = 0;
+        int delta = n - m;
+        bool front = delta % 2 != 0;
+        int k1start = 0, k1end = 0, k2start = 0, k2end = 0;
+
+        for (int d = 0; d < maxD; d++)
+        {
+            for (int k1 = -d + k1start; k1 <= d - k1end; k1 += 2)
+            {
+                int k1Offset = offset + k1;
+                int x1 = (k1 == -d || (k1 != d && forward[k1Offset - 1] < forward[k1Offset + 1]))
+                             ? forward[k1Offset + 1]
+                             : forward[k1Offset - 1] + 1;
+                int y1 = x1 - k1;
+                while (x1 < n && y1 < m && a[x1] == b[y1])
+                {
+                    x1++;
+                    y1++;
+                }
+                forward[k1Offset] = x1;
+                if (x1 > n)
+                    k1end += 2;
+                else if (y1 > m)
+                    k1start += 2;
+                else if (front)
+                {
+                    int k2Offset = offset + delta - k1;
+                    if (k2Offset >= 0 && k2Offset < length && backward[k2Offset] != -1 && x1 >= n - backward[k2Offset])
+                        return {x1, y1};
+                }
+            }
+
+            for (int k2 = -d + k2start; k2 <= d - k2end; k2 += 2)
+            {
+                int k2Offset = offset + k2;
+                int x2 = (k2 == -d || (k2 != d && backward[k2Offset - 1] < backward[k2Offset + 1]))
+                             ? backward[k2Offset + 1]
+                             : backward[k2Offset - 1] + 1;
+                int y2 = x2 - k2;
+                while (x2 < n && y2 < m && a[n - x2 - 1] == b[m - y2 - 1])
+                {
+                    x2++;
+                    y2++;
+                }
+                backward[k2Offset] = x2;
+                if (x2 > n)
+                    k2end += 2;
+                else if (y2 > m)
+                    k2start += 2;
+                else if (!front)
+                {
+                    int k1Offset = offset + delta - k2;
+                    if (k1Offset >= 0 && k1Offset < length && forward[k1Offset] != -1)
+                    {
+                        int x1 = forward[k1Offset];
+                        if (x1 >= n - x2)
+                            return {x1, x1 - (k1Offset - offset)};
+                    }
+                }
+            }
+
+            if (d >= maxCost)
+            {
+                // Too expensive to finish: split where the forward search got furthest
+                int bestX = 0, bestY = 0;
+                for (int k1 = -d + k1start; k1 <= d - k1end; k1 += 2)
+                {
+                    int x1 = forward[offset + k1], y1 = x1 - k1;
+                    if (x1 >= 0 && x1 <= n && y1 >= 0 && y1 <= m && x1 + y1 > bestX + bestY)
+                    {
+                        bestX = x1;
+                        bestY = y1;
+                    }
+                }
+                return {bestX, bestY};
+            }
+        }
+        return {n, m};
+    }
+
+    void compare(size_t aLo, size_t aHi, size_t bLo, size_t bHi)
+    {
+        while (aLo < aHi && bLo < bHi && seqA[aLo] == seqB[bLo])
+        {
+            aLo++;
+            bLo++;
+        }
+        while (aLo < aHi && bLo < bHi && seqA[aHi - 1] == seqB[bHi - 1])
+        {
+            aHi--;
+            bHi--;
+        }
+        if (aLo == aHi || bLo == bHi)
+        {
+            markRange(aLo, aHi, bLo, bHi);
+            return;
+        }
+        auto [x, y] = bisect(aLo, aHi, bLo, bHi);
+        if ((x == 0 && y == 0) || (size_t(x) == aHi - aLo && size_t(y) == bHi - bLo))
+        {
+            // No common line left to split on
+            markRange(aLo, aHi, bLo, bHi);
+            return;
+        }
+        compare(aLo, aLo + x, bLo, bLo + y);
+        compare(aLo + x, aHi, bLo + y, bHi);
+    }
+
+    static void appendRange(string &out, size_t start, size_t count)
+    {
+        out += to_string(count == 0 ? start : start + 1);
+        if (count != 1)
+            out += "," + to_string(count);
+    }
+
+    static void appendLine(string &out, char marker, string_view line)
+    {
+        out.push_back(marker);
+        out.append(line);
+        if (line.empty() || line.back() != '\n')
+            out += "\n\\ No newline at end of file\n";
+    }
+
+public:
+    // Splits content into lines, each keeping its '\n' (the last may have none)
+    static vector<string_view> split(string_view content)
+    {
+        vector<string_view> lines;
+        lines.reserve(count(content.begin(), content.end(), '\n') + 1);
+        while (!content.empty())
+        {
+            size_t newline = content.find('\n');
+            size_t length = newline == string_view::npos ? content.size() : newline + 1;
+            lines.push_back(content.substr(0, length));
+            content.remove_prefix(length);
+        }
+        return lines;
+    }
+
+    LineDiff(const vector<string_view> &before, const vector<string_view> &after)
+        : oldLines(before), newLines(after), removed(before.size(), 0), added(after.size(), 0)
+    {
+        size_t n = oldLines.size(), m = newLines.size();
+        size_t prefix = 0;
+        while (prefix < n && prefix < m && oldLines[prefix] == newLines[prefix])
+            prefix++;
+        size_t suffix = 0;
+        while (suffix < n - prefix && suffix < m - prefix && oldLines[n - 1 - suffix] == newLines[m - 1 - suffix])
+            suffix++;
+
+        Interner interner((n - prefix - suffix) + (m - prefix - suffix));
+        vector<uint32_t> idsA, idsB;
+        idsA.reserve(n - prefix - suffix);
+        idsB.reserve(m - prefix - suffix);
+        for (size_t i = prefix; i < n - suffix; i++)
+            idsA.push_back(interner.intern(oldLines[i]));
+        for (size_t j = prefix; j < m - suffix; j++)
+            idsB.push_back(interner.intern(newLines[j]));
+
+        vector<char> inA(interner.size(), 0), inB(interner.size(), 0);
+        for (uint32_t id : idsA)
+            inA[id] = 1;
+        for (uint32_t id : idsB)
+            inB[id] = 1;
+        for (size_t i = 0; i < idsA.size(); i++)
+        {
+            if (!inB[idsA[i]])
+                removed[prefix + i] = 1;
+            else
+            {
+                seqA.push_back(idsA[i]);
+                posA.push_back(prefix + i);
+            }
+        }
+        for (size_t j = 0; j < idsB.size(); j++)
+        {
+            if (!inA[idsB[j]])
+                added[prefix + j] = 1;
+            else
+            {
+                seqB.push_back(idsB[j]);
+                posB.push_back(prefix + j);
+            }
+        }
+
+        maxCost = 256;
+        while (size_t(maxCost) * maxCost < seqA.size() + seqB.size())
+            maxCost *= 2;
+        compare(0, seqA.size(), 0, seqB.size());
+    }
+
+    bool identical() const
+    {
+        return find(removed.begin(), removed.end(), 1) == removed.end() &&
+               find(added.begin(), added.end(), 1) == added.end();
+    }
+
+    // Writes "@@ -a,b +c,d @@" hunks with `context` unchanged lines around each change
+    void writeUnified(const function<void(string_view)> &write, unsigned context) const
+    {
+        struct Region
+        {
+            size_t i0, i1, j0, j1;
+        };
+        size_t n = oldLines.size(), m = newLines.size();
+        vector<Region> regions;
+        for (size_t i = 0, j = 0; i < n || j < m;)
+        {
+            if ((i < n && removed[i]) || (j < m && added[j]))
+            {
+                Region region{i, i, j, j};
+                while (i < n && removed[i])
+                    i++;
+                while (j < m && added[j])
+                    j++;
+                region.i1 = i;
+                region.j1 = j;
+                regions.push_back(region);
+            }
+            else
+            {
+                i++;
+                j++;
+            }
+        }
+
+        string out;
+        for (size_t first = 0; first < regions.size();)
+        {
+            // Changes closer than two contexts apart share a hunk
+            size_t last = first;
+            while (last + 1 < regions.size() && regions[last + 1].i0 - regions[last].i1 <= 2 * size_t(context))
+                last++;
+            size_t before = min<size_t>(context, regions[first].i0 - (first > 0 ? regions[first - 1].i1 : 0));
+            size_t after = min<size_t>(context, (last + 1 < regions.size() ? regions[last + 1].i0 : n) - regions[last].i1);
+            size_t oldStart = regions[first].i0 - before, oldEnd = regions[last].i1 + after;
+            size_t newStart = regions[first].j0 - before, newEnd = regions[last].j1 + after;
+
+            out += "@@ -";
+            appendRange(out, oldStart, oldEnd - oldStart);
+            out += " +";
+            appendRange(out, newStart, newEnd - newStart);
+            out += " @@\n";
+            size_t i = oldStart;
+            for (size_t r = first; r <= last; r++)
+            {
+                for (; i < regions[r].i0; i++)
+                    appendLine(out, ' ', oldLines[i]);
+                for (; i < regions[r].i1; i++)
+                    appendLine(out, '-', oldLines[i]);
+                for (size_t j = regions[r].j0; j < regions[r].j1; j++)
+                    appendLine(out, '+', newLines[j]);
+                if (out.size() >= HUNK_BUFFER)
+                {
+                    write(out);
+                    out.clear();
+                }
+            }
+            for (; i < oldEnd; i++)
+                appendLine(out, ' ', oldLines[i]);
+            first = last + 1;
+        }
+        if (!out.empty())
+            write(out);
+    }
+};
+
+// A pack (objects/pack/pack-<checksum>.pack) and its index (.idx), both mmapped.
+//
+// Pack, version 1:
+//   "MGPK" | version u32 | object count u32
+//   objects, each: type+size header (type in bits 4-6 of the first byte, size in 4 + 7n bits),
+//                  for OFS_DELTA the distance back to the base object, then a zlib stream
+//   SHA1 of everything above
+//
+// Index, version 1:
+//   "MGPI" | version u32 | fanout[256] u32 (objects whose first SHA byte is <= i)
+//   sorted raw SHAs (20 bytes each) | pack offsets u32 each (high bit set: index into the
+//   u64 table that follows, for packs over 2 GiB) | pack checksum | SHA1 of the index
+class PackFile
+{
+private:
+    const unsigned char *idx = nullptr;
+    size_t idxLength = 0;
+    const unsigned char *pack = nullptr;
+    size_t packLength = 0;
+    uint32_t count = 0;
+    size_t largeCount = 0;
+
+    // Resolved delta bases keyed by pack offset, least recently used at the back. Reading the
+    // objects of one chain in turn then inflates each base once instead of once per reader.
+    static constexpr size_t BASE_CACHE_SIZE = 16 * 1024 * 1024;
+    mutable list<uint64_t> baseOrder;
+    mutable unordered_map<uint64_t, pair<shared_ptr<const pair<int, string>>, list<uint64_t>::iterator>> bases;
+    mutable size_t baseBytes = 0;
+    mutable mutex baseLock;
+
+    static const unsigned char *mapFile(const string &path, size_t &length)
+    {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw runtime_error("Cannot open " + path);
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0)
+        {
+            close(fd);
+            throw runtime_error("Cannot stat " + path);
+        }
+        void *mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (mapped == MAP_FAILED)
+            throw runtime_error("Cannot mmap " + path);
+        length = st.st_size;
+        return static_cast<const unsigned char *>(mapped);
+    }
+
+    const unsigned char *fanout() const { return idx + 8; }
+    const unsigned char *shaTable() const { return fanout() + 256 * 4; }
+    const unsigned char *offsetTable() const { return shaTable() + size_t(count) * SHA_DIGEST_LENGTH; }
+
+    // Checks the tables before anything indexes into them: the fanout must be monotonic and every
+    // offset, direct or through the large-offset table, must point inside the pack
+    bool validIndex() const
+    {
+        uint32_t previous = 0;
+        for (int i = 0; i < 256; i++)
+        {
+            uint32_t value = getBE32(fanout() + i * 4);
+            if (value < previous)
+                return false;
+            previous = value;
+        }
+        size_t packEnd = packLength - SHA_DIGEST_LENGTH;
+        for (uint32_t i = 0; i < count; i++)
+        {
+            uint32_t offset = getBE32(offsetTable() + size_t(i) * 4);
+            if (offset & 0x80000000u)
+            {
+                if ((offset & 0x7fffffffu) >= largeCount)
+                    return false;
+                if (getBE64(offsetTable() + size_t(count) * 4 + size_t(offset & 0x7fffffffu) * 8) >= packEnd)
+                    return false;
+            }
+            else if (offset < 12 || offset >= packEnd)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+public:
+    static constexpr int OBJ_COMMIT = 1;
+    static constexpr int OBJ_TREE = 2;
+    static constexpr int OBJ_BLOB = 3;
+    static constexpr int OBJ_OFS_DELTA = 6;
+
+    string packPath;
+
+    PackFile(const string &indexPath, const string &packFilePath) : packPath(packFilePath)
+    {
+        idx = mapFile(indexPath, idxLength);
+        if (idxLength < 8 + 256 * 4 + 2 * SHA_DIGEST_LENGTH || memcmp(idx, "MGPI", 4) != 0 || getBE32(idx + 4) != 1)
+        {
+            munmap(const_cast<unsigned char *>(idx), idxLength);
+            throw runtime_error("Unsupported pack index: " + indexPath);
+        }
+        count = getBE32(fanout() + 255 * 4);
+        size_t fixed = 8 + 256 * 4 + size_t(count) * (SHA_DIGEST_LENGTH + 4) + 2 * SHA_DIGEST_LENGTH;
+        // The large-offset table must exactly fill the space left before the two trailing SHAs
+        if (idxLength < fixed || (idxLength - fixed) % 8 != 0)
+        {
+            munmap(const_cast<unsigned char *>(idx), idxLength);
+            throw runtime_error("Unsupported pack index: " + indexPath);
+        }
+        largeCount = (idxLength - fixed) / 8;
+        try
+        {
+            pack = mapFile(packFilePath, packLength);
+        }
+        catch (...)
+        {
+            munmap(const_cast<unsigned char *>(idx), idxLength);
+            throw;
+        }
+        if (packLength < 12 + SHA_DIGEST_LENGTH || memcmp(pack, "MGPK", 4) != 0 || getBE32(pack + 8) != count)
+        {
+            munmap(const_cast<unsigned char *>(idx), idxLength);
+            munmap(const_cast<unsigned char *>(pack), packLength);
+            throw runtime_error("Pack does not match its index: " + packFilePath);
+        }
+        if (!validIndex())
+        {
+            munmap(const_cast<unsigned char *>(idx), idxLength);
+            munmap(const_cast<unsigned char *>(pack), packLength);
+            throw runtime_error("Unsupported pack index: " + indexPath);
+        }
+    }
+    PackFile(const PackFile &) = delete;
+    PackFile &operator=(const PackFile &) = delete;
+    ~PackFile()
+    {
+        munmap(const_cast<unsigned char *>(idx), idxLength);
+        munmap(const_cast<unsigned char *>(pack), packLength);
+    }
+
+    uint32_t size() const { return count; }
+    const unsigned char *data() const { return pack; }
+    size_t length() const { return packLength; }
+
+    shared_ptr<const pair<int, string>> cachedBase(uint64_t offset) const
+    {
+        lock_guard<mutex> guard(baseLock);
+        auto it = bases.find(offset);
+        if (it == bases.end())
+            return nullptr;
+        baseOrder.splice(baseOrder.begin(), baseOrder, it->second.second);
+        return it->second.first;
+    }
+
+    void cacheBase(uint64_t offset, shared_ptr<const pair<int, string>> base) const
+    {
+        lock_guard<mutex> guard(baseLock);
+        if (base->second.size() > BASE_CACHE_SIZE / 4 || bases.count(offset))
+            return;
+        baseOrder.push_front(offset);
+        baseBytes += base->second.size();
+        bases[offset] = {move(base), baseOrder.begin()};
+        while (baseBytes > BASE_CACHE_SIZE)
+        {
+            auto oldest = bases.find(baseOrder.back());
+            baseBytes -= oldest->second.first->second.size();
+            bases.erase(oldest);
+            baseOrder.pop_back();
+        }
+    }
+
+    string shaAt(uint32_t i) const { return rawToHex(shaTable() + size_t(i) * SHA_DIGEST_LENGTH); }
+
+    uint64_t offsetAt(uint32_t i) const
+    {
+        uint32_t offset = getBE32(offsetTable() + size_t(i) * 4);
+        if (!(offset & 0x80000000u))
+            return offset;
+        const unsigned char *large = offsetTable() + size_t(count) * 4;
+        return getBE64(large + size_t(offset & 0x7fffffffu) * 8);
+    }
+
+    // Fanout narrows the search to SHAs sharing the first byte, then binary search
+    bool find(const unsigned char *rawSha, uint64_t &offset) const
+    {
+        uint32_t lo = rawSha[0] == 0 ? 0 : getBE32(fanout() + (rawSha[0] - 1) * 4);
+        uint32_t hi = getBE32(fanout() + rawSha[0] * 4);
+        while (lo < hi)
+        {
+            uint32_t mid = lo + (hi - lo) / 2;
+            int cmp = memcmp(shaTable() + size_t(mid) * SHA_DIGEST_LENGTH, rawSha, SHA_DIGEST_LENGTH);
+            if (cmp == 0)
+            {
+                offset = offsetAt(mid);
+                return true;
+            }
+            if (cmp < 0)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        return false;
+    }
+
+    // Writes an index for `entries` (raw SHA -> pack offset) next to a finished pack
+    static void writeIndex(const string &indexPath, vector<pair<string, uint64_t>> entries, const string &packChecksum)
+    {
+        sort(entries.begin(), entries.end());
+        string out = "MGPI";
+        putBE32(out, 1);
+        uint32_t counts[256] = {0};
+        for (const auto &entry : entries)
+            counts[static_cast<unsigned char>(entry.first[0])]++;
+        uint32_t running = 0;
+        for (int i = 0; i < 256; i++)
+        {
+            running += counts[i];
+            putBE32(out, running);
+        }
+        for (const auto &entry : entries)
+            out += entry.first;
+        string large;
+        uint32_t largeCount = 0;
+        for (const auto &entry : entries)
+        {
+            if (entry.second < 0x80000000u)
+            {
+                putBE32(out, entry.second);
+            }
+            else
+            {
+                putBE32(out, 0x80000000u | largeCount++);
+                putBE64(large, entry.second);
+            }
+        }
+        out += large;
+        out += packChecksum;
+        ObjectId checksum = Sha1::hash(out);
+        out.append(reinterpret_cast<const char *>(checksum.data()), SHA_DIGEST_LENGTH);
+
+        ofstream file(indexPath, ios::binary | ios::trunc);
+        file.write(out.data(), out.size());
+        if (!file)
+            throw runtime_error("Cannot write pack index " + indexPath);
+    }
+};
+
+// Commit-graph (objects/info/commit-graph), version 1: a fixed-width table of every commit
+// reachable from HEAD, so history walks index an mmapped array instead of parsing commits.
+//
+//   "MGCG" | version u32 | commit count u32
+//   fanout[256] u32 (commits whose first SHA byte is <= i)
+//   records sorted by commit SHA: commit SHA | tree SHA | parent positions u32 x2 | generation u32 |
+//                                 committer timestamp i64
+//   SHA1 of everything above
+//
+// Parent positions index this same table (NO_PARENT when absent). A commit's generation is one
+// more than its parents' maximum, so a commit can only be an ancestor of commits with a higher one.
+class CommitGraph
+{
+private:
+    static constexpr size_t HEADER_SIZE = 12;
+    static constexpr size_t RECORD_SIZE = 2 * SHA_DIGEST_LENGTH + 4 + 4 + 4 + 8;
+
+    const unsigned char *data = nullptr;
+    size_t length = 0;
+    uint32_t count = 0;
+
+    const unsigned char *fanout() const { return data + HEADER_SIZE; }
+    const unsigned char *record(uint32_t pos) const { return fanout() + 256 * 4 + size_t(pos) * RECORD_SIZE; }
+
+    void unmap()
+    {
+        if (data)
+            munmap(const_cast<unsigned char *>(data), length);
+        data = nullptr;
+        length = 0;
+        count = 0;
+    }
+
+public:
+    static constexpr uint32_t NO_PARENT = 0xffffffffu;
+
+    struct Commit
+    {
+        string sha;
+        string tree;
+        vector<string> parents;
+        int64_t timestamp = 0;
+    };
+
+    CommitGraph() = default;
+    CommitGraph(const CommitGraph &) = delete;
+    CommitGraph &operator=(const CommitGraph &) = delete;
+    ~CommitGraph() { unmap(); }
+
+    // Maps the graph at `path`; returns false (and stays empty) when there is no usable graph
+    bool load(const string &path)
+    {
+        unmap();
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat st;
+        if (fstat(fd, &st) != 0 || size_t(st.st_size) < HEADER_SIZE + 256 * 4 + SHA_DIGEST_LENGTH)
+        {
+            close(fd);
+            return false;
+        }
+        void *mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (mapped == MAP_FAILED)
+            return false;
+        data = static_cast<const unsigned char *>(mapped);
+        length = st.st_size;
+
+        count = getBE32(data + 8);
+        if (memcmp(data, "MGCG", 4) != 0 || getBE32(data + 4) != 1 || getBE32(fanout() + 255 * 4) != count ||
+            HEADER_SIZE + 256 * 4 + size_t(count) * RECORD_SIZE + SHA_DIGEST_LENGTH != length)
+        {
+            cerr << "Warning: ignoring corrupt commit-graph " << path << endl;
+            unmap();
+            return false;
+        }
+        return true;
+    }
+
+    uint32_t size() const { return count; }
+
+    bool find(const string &sha, uint32_t &pos) const
+    {
+        if (!data || sha.size() != 2 * SHA_DIGEST_LENGTH)
+            return false;
+        string raw = hexToRaw(sha);
+        unsigned char first = static_cast<unsigned char>(raw[0]);
+        uint32_t lo = first == 0 ? 0 : getBE32(fanout() + (first - 1) * 4);
+        uint32_t hi = getBE32(fanout() + first * 4);
+        while (lo < hi)
+        {
+            uint32_t mid = lo + (hi - lo) / 2;
+            int cmp = memcmp(record(mid), raw.data(), SHA_DIGEST_LENGTH);
+            if (cmp == 0)
+            {
+                pos = mid;
+                return true;
+            }
+            if (cmp < 0)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        return false;
+    }
+
+    string sha(uint32_t pos) const { return rawToHex(record(pos)); }
+    string tree(uint32_t pos) const { return rawToHex(record(pos) + SHA_DIGEST_LENGTH); }
+    uint32_t parent(uint32_t pos, int which) const { return getBE32(record(pos) + 2 * SHA_DIGEST_LENGTH + 4 * which); }
+    uint32_t generation(uint32_t pos) const { return getBE32(record(pos) + 2 * SHA_DIGEST_LENGTH + 8); }
+    int64_t timestamp(uint32_t pos) const { return static_cast<int64_t>(getBE64(record(pos) + 2 * SHA_DIGEST_LENGTH + 12)); }
+
+    // Writes a graph for `commits`, which must be closed under parents
+    static void write(const string &path, vector<Commit> commits)
+    {
+        sort(commits.begin(), commits.end(), [](const Commit &a, const Commit &b)
+             { return a.sha < b.sha; });
+        unordered_map<string, uint32_t> positions;
+        for (uint32_t i = 0; i < commits.size(); i++)
+            positions[commits[i].sha] = i;
+
+        // Generations via an explicit stack, since histories can be far deeper than the call stack
+        vector<uint32_t> generations(commits.size(), 0);
+        for (uint32_t start = 0; start < commits.size(); start++)
+        {
+            vector<uint32_t> stack = {start};
+            while (!stack.empty())
+            {
+                uint32_t pos = stack.back();
+                if (generations[pos])
+                {
+                    stack.pop_back();
+                    continue;
+                }
+                uint32_t highest = 0;
+                bool ready = true;
+                for (const string &parent : commits[pos].parents)
+                {
+                    uint32_t parentPos = positions.at(parent);
+                    if (!generations[parentPos])
+                    {
+                        stack.push_back(parentPos);
+                        ready = false;
+                    }
+                    highest = max(highest, generations[parentPos]);
+                }
+                if (ready)
+                {
+                    generations[pos] = highest + 1;
+                    stack.pop_back();
+                }
+            }
+        }
+
+        string out = "MGCG";
+        putBE32(out, 1);
+        putBE32(out, commits.size());
+        uint32_t counts[256] = {0};
+        for (const Commit &commit : commits)
+            counts[stoi(commit.sha.substr(0, 2), nullptr, 16)]++;
+        uint32_t running = 0;
+        for (int i = 0; i < 256; i++)
+        {
+            running += counts[i];
+            putBE32(out, running);
+        }
+        for (uint32_t i = 0; i < commits.size(); i++)
+        {
+            const Commit &commit = commits[i];
+            out += hexToRaw(commit.sha);
+            out += hexToRaw(commit.tree);
+            for (size_t which = 0; which < 2; which++)
+                putBE32(out, which < commit.parents.size() ? positions.at(commit.parents[which]) : NO_PARENT);
+            putBE32(out, generations[i]);
+            putBE64(out, static_cast<uint64_t>(commit.timestamp));
+        }
+        ObjectId checksum = Sha1::hash(out);
+        out.append(reinterpret_cast<const char *>(checksum.data()), SHA_DIGEST_LENGTH);
+
+        string tempPath = path + ".lock";
+        ofstream file(tempPath, ios::binary | ios::trunc);
+        file.write(out.data(), out.size());
+        file.close();
+        if (!file || rename(tempPath.c_str(), path.c_str()) != 0)
+        {
+            unlink(tempPath.c_str());
+            throw runtime_error("Cannot write commit-graph " + path);
+        }
+    }
+};
+
+// Minimal io_uring wrapper over the raw system calls (no liburing needed): one submission ring
+// and one completion ring, driven by a single thread.
+class IoUring
+{
+    int ringFd = -1;
+    unsigned char *sqRing = nullptr;
+    unsigned char *cqRing = nullptr;
+    size_t sqRingSize = 0;
+    size_t cqRingSize = 0;
+    io_uring_sqe *sqes = nullptr;
+    size_t sqesSize = 0;
+    unsigned *sqTail = nullptr;
+    unsigned *sqMask = nullptr;
+    unsigned *sqArray = nullptr;
+    unsigned *cqHead = nullptr;
+    unsigned *cqTail = nullptr;
+    unsigned *cqMask = nullptr;
+    io_uring_cqe *cqes = nullptr;
+    unsigned entries = 0;
+    unsigned unsubmitted = 0;
+
+    static void *mapRing(int fd, size_t length, off_t offset)
+    {
+        void *mapped = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, offset);
+        return mapped == MAP_FAILED ? nullptr : mapped;
+    }
+
+public:
+    IoUring() = default;
+    IoUring(const IoUring &) = delete;
+    IoUring &operator=(const IoUring &) = delete;
+    ~IoUring() { shutdown(); }
+
+    // Sets up a ring of `depth` entries; false when io_uring is unavailable (old kernel, disabled,
+    // filtered by seccomp) or does not support every opcode in `ops`
+    bool open(unsigned depth, const vector<int> &ops)
+    {
+        io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        int fd = syscall(__NR_io_uring_setup, depth, &params);
+        if (fd < 0)
+            return false;
+        ringFd = fd;
+        entries = params.sq_entries;
+        sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool singleMap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (singleMap)
+            sqRingSize = cqRingSize = max(sqRingSize, cqRingSize);
+        sqRing = static_cast<unsigned char *>(mapRing(fd, sqRingSize, IORING_OFF_SQ_RING));
+        cqRing = singleMap ? sqRing : static_cast<unsigned char *>(mapRing(fd, cqRingSize, IORING_OFF_CQ_RING));
+        sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+        sqes = static_cast<io_uring_sqe *>(mapRing(fd, sqesSize, IORING_OFF_SQES));
+        if (!sqRing || !cqRing || !sqes)
+        {
+            shutdown();
+            return false;
+        }
+        sqTail = reinterpret_cast<unsigned *>(sqRing + params.sq_off.tail);
+        sqMask = reinterpret_cast<unsigned *>(sqRing + params.sq_off.ring_mask);
+        sqArray = reinterpret_cast<unsigned *>(sqRing + params.sq_off.array);
+        cqHead = reinterpret_cast<unsigned *>(cqRing + params.cq_off.head);
+        cqTail = reinterpret_cast<unsigned *>(cqRing + params.cq_off.tail);
+        cqMask = reinterpret_cast<unsigned *>(cqRing + params.cq_off.ring_mask);
+        cqes = reinterpret_cast<io_uring_cqe *>(cqRing + params.cq_off.cqes);
+
+        vector<unsigned char> probeBuffer(sizeof(io_uring_probe) + 256 * sizeof(io_uring_probe_op), 0);
+        auto *probe = reinterpret_cast<io_uring_probe *>(probeBuffer.data());
+        if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, 256) < 0)
+        {
+            shutdown();
+            return false;
+        }
+        for (int op : ops)
+        {
+            if (op > probe->last_op || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED))
+            {
+                shutdown();
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void shutdown()
+    {
+        if (sqes)
+            munmap(sqes, sqesSize);
+        if (cqRing && cqRing != sqRing)
+            munmap(cqRing, cqRingSize);
+        if (sqRing)
+            munmap(sqRing, sqRingSize);
+        if (ringFd >= 0)
+            close(ringFd);
+        sqes = nullptr;
+        sqRing = cqRing = nullptr;
+        ringFd = -1;
+    }
+
+    unsigned depth() const { return entries; }
+
+    // Queues a zeroed submission entry for the caller to fill in. The kernel only reads entries
+    // in io_uring_enter, so publishing the tail before the entry is filled is safe. At most
+    // depth() entries may be queued per run().
+    io_uring_sqe &prepare()
+    {
+        unsigned tail = *sqTail;
+        unsigned index = tail & *sqMask;
+        io_uring_sqe &sqe = sqes[index];
+        memset(&sqe, 0, sizeof(sqe));
+        sqArray[index] = index;
+        __atomic_store_n(sqTail, tail + 1, __ATOMIC_RELEASE);
+        unsubmitted++;
+        return sqe;
+    }
+
+    // Submits everything prepared and waits for `count` completions, handing each to `complete`
+    void run(unsigned count, const function<void(const io_uring_cqe &)> &complete)
+    {
+        unsigned done = 0;
+        while (true)
+        {
+            unsigned head = *cqHead;
+            unsigned tail = __atomic_load_n(cqTail, __ATOMIC_ACQUIRE);
+            for (; head != tail; head++, done++)
+                complete(cqes[head & *cqMask]);
+            __atomic_store_n(cqHead, head, __ATOMIC_RELEASE);
+            if (done >= count)
+                return;
+            int submitted = syscall(__NR_io_uring_enter, ringFd, unsubmitted, count - done, IORING_ENTER_GETEVENTS,
+                                    nullptr, 0);
+            if (submitted < 0)
+            {
+                if (errno == EINTR || errno == EAGAIN || errno == EBUSY)
+                    continue;
+                throw runtime_error(string("io_uring_enter failed: ") + strerror(errno));
+            }
+            unsubmitted -= submitted;
+        }
+    }
+};
+
+// Asynchronous loose-object writer. Threads that produce compressed objects queue them here
+// and go on hashing and compressing while a background thread does the I/O:
+//   - io_uring: each batch of up to BATCH objects takes three rounds: open every temp file,
+//     write them all, then close each one and (linked to a successful close) rename it into
+//     place. That is three system calls per batch instead of four per object.
+//   - threads: where io_uring is unavailable, WRITER_THREADS threads do the same with plain
+//     system calls, so slow storage still sees several writes in flight.
+//   - sync: objects are written by the caller, for debugging and comparison.
+// Fan-out directories are created once per process. Nothing is fsynced per object; sync()
+// waits for the queue and then makes everything durable with a single syncfs().
+class ObjectWriter
+{
+public:
+    enum class Backend
+    {
+        Sync,
+        Threads,
+        IoUring
+    };
+
+private:
+    struct Pending
+    {
+        string sha;
+        string data;
+    };
+
+    static constexpr size_t BATCH = 64;
+    // How long the io_uring thread waits for a batch to fill up before writing a partial one
+    static constexpr chrono::microseconds BATCH_LINGER{500};
+    static constexpr unsigned WRITER_THREADS = 8;
+    // Producers wait while this much compressed data is queued
+    static constexpr size_t MAX_QUEUED_BYTES = 64 * 1024 * 1024;
+
+    string objectsDir;
+    Backend mode;
+    IoUring ring;
+    array<atomic<bool>, 256> fanoutReady{};
+    atomic<bool> dirty{false};
+    atomic<size_t> outstanding{0};
+
+    mutex lock;
+    condition_variable changed;
+    deque<Pending> queue;
+    size_t queuedBytes = 0;
+    bool stopping = false;
+    size_t draining = 0; // threads waiting in drain(), which cuts the linger short
+    string firstError;
+    vector<thread> workers;
+
+    string objectPath(const string &sha) const { return objectsDir + "/" + sha.substr(0, 2) + "/" + sha.substr(2); }
+
+    string tempPath() { return tempFileName(objectsDir + "/tmp_obj_"); }
+
+    void ensureFanout(const string &sha)
+    {
+        size_t slot = stoul(sha.substr(0, 2), nullptr, 16);
+        if (fanoutReady[slot])
+            return;
+        string dir = objectsDir + "/" + sha.substr(0, 2);
+        if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST)
+            throw runtime_error("Cannot create " + dir + ": " + strerror(errno));
+        fanoutReady[slot] = true;
+    }
+
+    // Retries a rename that failed with ENOENT: repack (in this process or another) removes empty
+    // fan-out directories, so a cached one may be gone. Returns 0 or the errno of the retry.
+    int renameIntoNewFanout(const string &temp, const string &sha)
+    {
+        string dir = objectsDir + "/" + sha.substr(0, 2);
+        if (mkdir(dir.c_str(), 0755) != 0 && errno != EEXIST)
+            return errno;
+        return rename(temp.c_str(), objectPath(sha).c_str()) == 0 ? 0 : errno;
+    }
+
+    void writeOne(const Pending &object)
+    {
+        ensureFanout(object.sha);
+        string temp;
+        int fd = createTempFile(objectsDir + "/tmp_obj_", temp);
+        if (fd < 0)
+            throw runtime_error("Cannot create temporary object file in " + objectsDir);
+        try
+        {
+            writeAll(fd, object.data.data(), object.data.size());
+        }
+        catch (...)
+        {
+            close(fd);
+            unlink(temp.c_str());
+            throw;
+        }
+        int error = close(fd) != 0 ? errno : 0;
+        if (error == 0 && rename(temp.c_str(), objectPath(object.sha).c_str()) != 0)
+        {
+            error = errno == ENOENT ? renameIntoNewFanout(temp, object.sha) : errno;
+        }
+        if (error != 0)
+        {
+            unlink(temp.c_str());
+            throw runtime_error("Cannot write object " + object.sha + ": " + strerror(error));
+        }
+    }
+
+    void writeBatch(const vector<Pending> &batch)
+    {
+        TraceScope trace("object-writer.batch");
+        size_t count = batch.size();
+        vector<string> temps(count);
+        vector<string> finals(count);
+        vector<int> fds(count, -1);
+        vector<string> errors(count);
+        for (size_t i = 0; i < count; i++)
+        {
+            ensureFanout(batch[i].sha);
+            temps[i] = tempPath();
+            finals[i] = objectPath(batch[i].sha);
+        }
+        auto fail = [&](size_t i, const string &step, int error)
+        {
+            if (errors[i].empty())
+                errors[i] = step + ": " + strerror(error);
+        };
+
+        // 1. Open every temp file
+        for (size_t i = 0; i < count; i++)
+        {
+            io_uring_sqe &sqe = ring.prepare();
+            sqe.opcode = IORING_OP_OPENAT;
+            sqe.fd = AT_FDCWD;
+            sqe.addr = reinterpret_cast<uint64_t>(temps[i].c_str());
+            sqe.open_flags = O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC;
+            sqe.len = 0644;
+            sqe.user_data = i;
+        }
+        ring.run(count, [&](const io_uring_cqe &cqe)
+                 {
+            if (cqe.res < 0)
+                fail(cqe.user_data, "open", -cqe.res);
+            else
+                fds[cqe.user_data] = cqe.res; });
+
+        // 2. Write them; a short write is finished synchronously
+        unsigned submitted = 0;
+        for (size_t i = 0; i < count; i++)
+        {
+            if (fds[i] < 0)
+                continue;
+            io_uring_sqe &sqe = ring.prepare();
+            sqe.opcode = IORING_OP_WRITE;
+            sqe.fd = fds[i];
+            sqe.addr = reinterpret_cast<uint64_t>(batch[i].data.data());
+            sqe.len = min<size_t>(batch[i].data.size(), 1u << 30);
+            sqe.off = 0;
+            sqe.user_data = i;
+            submitted++;
+        }
+        ring.run(submitted, [&](const io_uring_cqe &cqe)
+                 {
+            size_t i = cqe.user_data;
+            if (cqe.res < 0)
+            {
+                fail(i, "write", -cqe.res);
+                return;
+            }
+            try
+            {
+                writeAll(fds[i], batch[i].data.data() + cqe.res, batch[i].data.size() - cqe.res);
+            }
+            catch (const exception &e)
+            {
+                errors[i] = e.what();
+            } });
+
+        // 3. Close each file; a rename linked to the close only runs if the close succeeded
+        submitted = 0;
+        for (size_t i = 0; i < count; i++)
+        {
+            if (fds[i] < 0)
+                continue;
+            io_uring_sqe &closeSqe = ring.prepare();
+            closeSqe.opcode = IORING_OP_CLOSE;
+            closeSqe.fd = fds[i];
+            closeSqe.user_data = 2 * i;
+            submitted++;
+            if (!errors[i].empty())
+                continue;
+            closeSqe.flags |= IOSQE_IO_LINK;
+            io_uring_sqe &renameSqe = ring.prepare();
+            renameSqe.opcode = IORING_OP_RENAMEAT;
+            renameSqe.fd = AT_FDCWD;
+            renameSqe.addr = reinterpret_cast<uint64_t>(temps[i].c_str());
+            renameSqe.len = AT_FDCWD;
+            renameSqe.addr2 = reinterpret_cast<uint64_t>(finals[i].c_str());
+            renameSqe.user_data = 2 * i + 1;
+            submitted++;
+        }
+        vector<char> missingFanout(count, 0);
+        ring.run(submitted, [&](const io_uring_cqe &cqe)
+                 {
+            size_t i = cqe.user_data / 2;
+            bool rename = cqe.user_data % 2;
+            if (rename && cqe.res == -ENOENT)
+                missingFanout[i] = 1;
+            else if (cqe.res < 0)
+                fail(i, rename ? "rename" : "close", -cqe.res); });
+        for (size_t i = 0; i < count; i++)
+        {
+            if (missingFanout[i])
+            {
+                if (int error = renameIntoNewFanout(temps[i], batch[i].sha))
+                    fail(i, "rename", error);
+            }
+        }
+
+        for (size_t i = 0; i < count; i++)
+        {
+            if (errors[i].empty())
+                continue;
+            unlink(temps[i].c_str());
+            lock_guard<mutex> guard(lock);
+            if (firstError.empty())
+                firstError = "Cannot write object " + batch[i].sha + ": " + errors[i];
+        }
+    }
+
+    // Takes up to `limit` objects off the queue, waiting for at least one (and with `linger`, a
+    // little longer for a full batch); empty when stopping
+    vector<Pending> take(size_t limit, bool linger)
+    {
+        unique_lock<mutex> guard(lock);
+        changed.wait(guard, [&]
+                     { return stopping || !queue.empty(); });
+        if (linger)
+            changed.wait_for(guard, BATCH_LINGER, [&]
+                             { return stopping || draining > 0 || queue.size() >= limit; });
+        vector<Pending> batch;
+        while (!queue.empty() && batch.size() < limit)
+        {
+            queuedBytes -= queue.front().data.size();
+            batch.push_back(move(queue.front()));
+            queue.pop_front();
+        }
+        changed.notify_all(); // room for producers
+        return batch;
+    }
+
+    void finished(size_t count)
+    {
+        lock_guard<mutex> guard(lock);
+        outstanding -= count;
+        changed.notify_all();
+    }
+
+    void ringLoop()
+    {
+        for (vector<Pending> batch = take(BATCH, true); !batch.empty(); batch = take(BATCH, true))
+        {
+            try
+            {
+                writeBatch(batch);
+            }
+            catch (const exception &e)
+            {
+                lock_guard<mutex> guard(lock);
+                if (firstError.empty())
+                    firstError = e.what();
+            }
+            finished(batch.size());
+        }
+    }
+
+    void threadLoop()
+    {
+        for (vector<Pending> batch = take(1, false); !batch.empty(); batch = take(1, false))
+        {
+            try
+            {
+                writeOne(batch[0]);
+            }
+            catch (const exception &e)
+            {
+                lock_guard<mutex> guard(lock);
+                if (firstError.empty())
+                    firstError = e.what();
+            }
+            finished(1);
+        }
+    }
+
+public:
+    // io_uring falls back to threads when the kernel does not offer it
+    ObjectWriter(const string &objectsPath, Backend backend) : objectsDir(objectsPath), mode(backend)
+    {
+        if (mode == Backend::IoUring &&
+            !ring.open(2 * BATCH, {IORING_OP_OPENAT, IORING_OP_WRITE, IORING_OP_CLOSE, IORING_OP_RENAMEAT}))
+        {
+            mode = Backend::Threads;
+        }
+    }
+    ObjectWriter(const ObjectWriter &) = delete;
+    ObjectWriter &operator=(const ObjectWriter &) = delete;
+    ~ObjectWriter()
+    {
+        {
+            lock_guard<mutex> guard(lock);
+            stopping = true;
+        }
+        changed.notify_all();
+        for (thread &worker : workers)
+            worker.join();
+    }
+
+    Backend backend() const { return mode; }
+
+    // True while queued objects may not have reached the object store yet
+    bool busy() const { return outstanding > 0; }
+
+    // Queues a compressed loose object ("<type> <size>$<content>" deflated) for `sha`
+    void submit(const string &sha, string data)
+    {
+        dirty = true;
+        if (mode == Backend::Sync)
+        {
+            writeOne({sha, move(data)});
+            return;
+        }
+        unique_lock<mutex> guard(lock);
+        if (workers.empty())
+        {
+            // Started on first use, so read-only commands never spawn them
+            unsigned count = mode == Backend::IoUring ? 1 : WRITER_THREADS;
+            for (unsigned i = 0; i < count; i++)
+                workers.emplace_back([this]
+                                     { mode == Backend::IoUring ? ringLoop() : threadLoop(); });
+        }
+        changed.wait(guard, [&]
+                     { return queuedBytes < MAX_QUEUED_BYTES || queue.empty(); });
+        queuedBytes += data.size();
+        outstanding++;
+        queue.push_back({sha, move(data)});
+        changed.notify_all();
+    }
+
+    // Records a write made outside the queue (streamed objects) for the next sync()
+    void noteWrite() { dirty = true; }
+
+    // Waits until every queued object is in place; rethrows the first write error
+    void drain()
+    {
+        unique_lock<mutex> guard(lock);
+        draining++;
+        changed.notify_all();
+        changed.wait(guard, [&]
+                     { return outstanding == 0; });
+        draining--;
+        if (!firstError.empty())
+        {
+            string error = move(firstError);
+            firstError.clear();
+            throw runtime_error(error);
+        }
+    }
+
+    // The durability barrier: drain the queue, then flush the object store's filesystem once
+    // (when `durable` and anything was written since the last barrier)
+    void sync(bool durable)
+    {
+        TraceScope trace("object-writer.sync");
+        drain();
+        if (!durable || !dirty.exchange(false))
+            return;
+        int fd = ::open(objectsDir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd < 0 || syncfs(fd) != 0)
+        {
+            int error = errno;
+            if (fd >= 0)
+                close(fd);
+            throw runtime_error("Cannot sync " + objectsDir + ": " + strerror(error));
+        }
+        close(fd);
+    }
+};
+
+// Filesystem monitor: a per-repository daemon that watches the working tree with inotify and
+// remembers which paths changed. Clients ask "what changed since <token>?" over a Unix socket
+// and get back a new token plus the changed paths, or "*" when they must fall back to a full scan
+// (unknown token, daemon restarted, or the kernel event queue overflowed).
+//
+// Protocol, one request per connection:
+//   query <token>\n  ->  <new token>\n  then "*\n" or one changed path per line
+//   stop\n           ->  ok\n
+class FsMonitor
+{
+public:
+    struct Changes
+    {
+        string token;        // empty when no daemon answered
+        bool fullScan = true; // true when `paths` cannot be trusted
+        vector<string> paths; // changed files and directories, relative to the working tree root
+    };
+
+private:
+    static constexpr uint32_t WATCH_MASK = IN_CREATE | IN_DELETE | IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB |
+                                           IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF;
+    static constexpr const char *COOKIE_PREFIX = "fsmonitor-cookie-";
+
+    string workTree;   // absolute; watched directories and reported paths are relative to it
+    string gitDirName; // skipped at the top of the working tree
+    string gitDir;
+    int inotifyFd = -1;
+    int listenFd = -1;
+    int gitDirWatch = -1;
+    unordered_map<int, string> watchedDirs; // watch descriptor -> directory ("" is the root)
+    unordered_map<string, uint64_t> dirty;  // path -> sequence number of its latest change
+    uint64_t sequence = 0;
+    string epoch;           // changes whenever earlier tokens stop being meaningful
+    unsigned generation = 0;
+    bool incomplete = false; // a watch could not be added, so some changes go unseen
+    unsigned cookieCount = 0;
+
+    // Binds (or connects) `fd` to the socket in the git directory. A path too long for
+    // sockaddr_un is reached through /proc/self/fd and an open descriptor of the directory.
+    bool socketCall(int fd, bool bindSocket) const
+    {
+        sockaddr_un address = {};
+        address.sun_family = AF_UNIX;
+        string path = socketPath();
+        int dirFd = -1;
+        if (path.size() >= sizeof(address.sun_path))
+        {
+            dirFd = open(gitDir.c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC);
+            if (dirFd < 0)
+                return false;
+            path = "/proc/self/fd/" + to_string(dirFd) + "/fsmonitor.sock";
+        }
+        strcpy(address.sun_path, path.c_str());
+        int result = bindSocket ? bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address))
+                                : connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address));
+        if (dirFd >= 0)
+            close(dirFd);
+        return result == 0;
+    }
+
+    void resetEpoch()
+    {
+        epoch = to_string(getpid()) + "-" + to_string(time(nullptr)) + "-" + to_string(generation++);
+        dirty.clear();
+    }
+
+    // Watch `dir` and everything below it, skipping the repository metadata directories
+    void watchTree(const string &dir)
+    {
+        string dirPath = workTree + "/" + dir;
+        int wd = inotify_add_watch(inotifyFd, dirPath.c_str(), WATCH_MASK | IN_ONLYDIR);
+        if (wd < 0)
+        {
+            if (errno != ENOENT && errno != ENOTDIR)
+                incomplete = true; // Usually the max_user_watches limit
+            return;
+        }
+        watchedDirs[wd] = dir;
+
+        unique_ptr<DIR, int (*)(DIR *)> handle(opendir(dirPath.c_str()), closedir);
+        if (!handle)
+            return;
+        while (dirent *item = readdir(handle.get()))
+        {
+            string name = item->d_name;
+            if (name == "." || name == ".." || (dir.empty() && (name == gitDirName || name == ".git")))
+                continue;
+            string path = dir.empty() ? name : dir + "/" + name;
+            struct stat st;
+            bool isDirectory = item->d_type == DT_DIR ||
+                               (item->d_type == DT_UNKNOWN && lstat((workTree + "/" + path).c_str(), &st) == 0 &&
+                                S_ISDIR(st.st_mode));
+            if (isDirectory)
+                watchTree(path);
+        }
+    }
+
+    // Drain queued inotify events; returns true if the cookie named `cookie` was among them
+    bool readEvents(const string &cookie)
+    {
+        bool sawCookie = false;
+        alignas(inotify_event) char buffer[64 * 1024];
+        while (true)
+        {
+            ssize_t length = read(inotifyFd, buffer, sizeof(buffer));
+            if (length <= 0)
+                return sawCookie; // EAGAIN: queue drained
+            for (char *cursor = buffer; cursor < buffer + length;)
+            {
+                const inotify_event *event = reinterpret_cast<const inotify_event *>(cursor);
+                cursor += sizeof(inotify_event) + event->len;
+                string name = event->len ? event->name : "";
+
+                if (event->mask & IN_Q_OVERFLOW)
+                {
+                    resetEpoch(); // Events were lost: every outstanding token is now invalid
+                    continue;
+                }
+                if (event->wd == gitDirWatch)
+                {
+                    if (!cookie.empty() && name == cookie)
+                        sawCookie = true;
+                    continue;
+                }
+                auto watched = watchedDirs.find(event->wd);
+                if (watched == watchedDirs.end())
+                    continue;
+                if (event->mask & IN_IGNORED)
+                {
+                    watchedDirs.erase(watched);
+                    continue;
+                }
+                const string &dir = watched->second;
+                if (name.empty())
+                {
+                    if (!dir.empty())
+                        dirty[dir] = ++sequence; // The directory itself was deleted or moved
+                    continue;
+                }
+                if (dir.empty() && (name == gitDirName || name == ".git"))
+                    continue;
+
+                string path = dir.empty() ? name : dir + "/" + name;
+                if ((event->mask & IN_ISDIR) && (event->mask & (IN_CREATE | IN_MOVED_TO)))
+                {
+                    watchTree(path); // Files may already exist in it; the dirty directory covers them
+                }
+                dirty[path] = ++sequence;
+            }
+        }
+    }
+
+    // Make sure every event that happened before this call has been read, using a cookie file
+    // in the git directory: inotify delivers events in order, so once its creation shows up
+    // everything older has been seen too
+    bool syncEvents()
+    {
+        string cookie = COOKIE_PREFIX + to_string(++cookieCount);
+        string cookiePath = gitDir + "/" + cookie;
+        int fd = open(cookiePath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+            return false;
+        close(fd);
+        bool synced = false;
+        auto deadline = chrono::steady_clock::now() + chrono::seconds(2);
+        while (!synced && chrono::steady_clock::now() < deadline)
+        {
+            pollfd ready = {inotifyFd, POLLIN, 0};
+            if (poll(&ready, 1, 100) > 0)
+                synced = readEvents(cookie);
+        }
+        unlink(cookiePath.c_str());
+        return synced;
+    }
+
+    string answerQuery(const string &token)
+    {
+        bool synced = syncEvents();
+        string reply = epoch + ":" + to_string(sequence) + "\n";
+        size_t colon = token.rfind(':');
+        if (!synced || incomplete || colon == string::npos || token.substr(0, colon) != epoch)
+        {
+            return reply + "*\n";
+        }
+        uint64_t since = strtoull(token.c_str() + colon + 1, nullptr, 10);
+        for (const auto &[path, changed] : dirty)
+        {
+            if (changed > since)
+                reply += path + "\n";
+        }
+        return reply;
+    }
+
+    // Helper function to read one request line from a client
+    static string readLine(int fd)
+    {
+        string line;
+        char c;
+        while (line.size() < 4096 && read(fd, &c, 1) == 1 && c != '\n')
+            line.push_back(c);
+        return line;
+    }
+
+    static void writeAllTo(int fd, const string &data)
+    {
+        size_t offset = 0;
+        while (offset < data.size())
+        {
+            ssize_t written = write(fd, data.data() + offset, data.size() - offset);
+            if (written <= 0)
+                return;
+            offset += written;
+        }
+    }
+
+public:
+    FsMonitor(const string &root, const string &gitDirectoryName)
+        : workTree(root), gitDirName(gitDirectoryName), gitDir(root + "/" + gitDirectoryName)
+    {
+    }
+
+    string socketPath() const { return gitDir + "/fsmonitor.sock"; }
+
+    // Run the watcher loop in the current process until a "stop" request arrives
+    void serve()
+    {
+        inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (inotifyFd < 0)
+            throw runtime_error("inotify_init1 failed");
+        gitDirWatch = inotify_add_watch(inotifyFd, gitDir.c_str(), IN_CREATE);
+        resetEpoch();
+        watchTree("");
+
+        listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        unlink(socketPath().c_str());
+        if (listenFd < 0 || !socketCall(listenFd, true) || listen(listenFd, 16) != 0)
+        {
+            throw runtime_error("Cannot listen on " + socketPath());
+        }
+
+        bool running = true;
+        while (running)
+        {
+            pollfd fds[2] = {{inotifyFd, POLLIN, 0}, {listenFd, POLLIN, 0}};
+            if (poll(fds, 2, -1) < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                break;
+            }
+            if (fds[0].revents & POLLIN)
+                readEvents("");
+            if (!(fds[1].revents & POLLIN))
+                continue;
+
+            int client = accept4(listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (client < 0)
+                continue;
+            timeval timeout = {2, 0};
+            setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+            string request = readLine(client);
+            if (request.rfind("query", 0) == 0)
+            {
+                writeAllTo(client, answerQuery(request.size() > 6 ? request.substr(6) : ""));
+            }
+            else if (request == "stop")
+            {
+                writeAllTo(client, "ok\n");
+                running = false;
+            }
+            close(client);
+        }
+
+        unlink(socketPath().c_str());
+        close(listenFd);
+        close(inotifyFd);
+    }
+
+    // Send one request to a running daemon; returns false when none is listening
+    bool request(const string &line, string &reply) const
+    {
+        int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (fd < 0)
+            return false;
+        timeval timeout = {5, 0};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        if (!socketCall(fd, false))
+        {
+            close(fd);
+            return false;
+        }
+        writeAllTo(fd, line + "\n");
+        reply.clear();
+        char buffer[64 * 1024];
+        ssize_t length;
+        while ((length = read(fd, buffer, sizeof(buffer))) > 0)
+            reply.append(buffer, length);
+        close(fd);
+        return length == 0 && !reply.empty();
+    }
+
+    // Ask the daemon for the paths changed since `token`
+    Changes query(const string &token) const
+    {
+        Changes changes;
+        string reply;
+        if (!request("query " + token, reply))
+            return changes;
+        istringstream lines(reply);
+        string line;
+        getline(lines, changes.token);
+        changes.fullScan = false;
+        while (getline(lines, line))
+        {
+            if (line == "*")
+                changes.fullScan = true;
+            else
+                changes.paths.push_back(line);
+        }
+        if (changes.fullScan)
+            changes.paths.clear();
+        return changes;
+    }
+};
+
+class MyGit
+{
+private:
+    static constexpr const char *GIT_DIR_NAME = ".mygit";
+    // Absolute working-tree root without a trailing slash; every file system call goes through it,
+    // so the engine never depends on the process working directory
+    const string WORK_TREE;
+    const string GIT_DIR = WORK_TREE + "/" + GIT_DIR_NAME;
+    const string OBJECTS_DIR = GIT_DIR + "/objects";
+    const string INDEX_PATH = GIT_DIR + "/index";
+    const string CONFIG_PATH = GIT_DIR + "/config";
+    const string COMMIT_GRAPH_PATH = OBJECTS_DIR + "/info/commit-graph";
+
+    Config config;
+
+    // Default budget for inflated objects kept in memory (core.objectCacheSize overrides it)
+    static constexpr size_t DEFAULT_OBJECT_CACHE_SIZE = 64 * 1024 * 1024;
+    ObjectCache objectCache{DEFAULT_OBJECT_CACHE_SIZE};
+
+    // Size of the buffer used when streaming file contents through SHA1 and zlib
+    static constexpr size_t STREAM_CHUNK_SIZE = 64 * 1024;
+    // Blobs up to this size are read into memory once; larger ones are streamed
+    static constexpr uintmax_t SMALL_BLOB_LIMIT = 1024 * 1024;
+    // With chunking.enabled, blobs of at least chunking.threshold bytes are stored as chunks of
+    // about chunking.averageSize bytes
+    static constexpr uintmax_t DEFAULT_CHUNK_THRESHOLD = 8 * 1024 * 1024;
+    static constexpr size_t DEFAULT_CHUNK_AVERAGE = 64 * 1024;
+
+    // Object existence answers from earlier lookups in this process, so repeated writes of the
+    // same content cost a hash and at most one stat
+    unordered_set<ObjectId, ObjectIdHash> knownObjects;
+    unordered_set<ObjectId, ObjectIdHash> missingObjects;
+    mutex objectCacheLock;
+    atomic<size_t> objectsWritten{0};
+    atomic<size_t> dedupedWrites{0};
+
+    // Queues loose-object writes (core.objectWriter: io_uring, threads or sync); commands call
+    // syncObjects() once before they update the index or HEAD
+    unique_ptr<ObjectWriter> objectWriter;
+
+    // Helper function to turn a path relative to the repository root into one for file system
+    // calls; absolute paths are returned unchanged
+    string workPath(const string &path) const
+    {
+        if (!path.empty() && path[0] == '/')
+            return path;
+        return WORK_TREE + "/" + path;
+    }
+
+    // Helper function to create directory if it doesn't exist
+    bool createDirectory(const string &path)
+    {
+        try
+        {
+            if (!fs::exists(path))
+            {
+                return fs::create_directories(path);
+            }
+            return true;
+        }
+        catch (const exception &e)
+        {
+            cerr << "Error creating directory: " << e.what() << endl;
+            return false;
+        }
+    }
+
+    // Helper function to compute SHA1 hash
+    string computeSHA1(const string &content)
+    {
+        return Sha1::hash(content).hex();
+    }
+
+    // Helper function to pick the zlib/zstd level for an object type from the config
+    // (compression.<type>, then compression.level, then the historical Z_BEST_COMPRESSION)
+    int compressionLevel(const string &type)
+    {
+        return config.getInt("compression." + type, config.getInt("compression.level", Z_BEST_COMPRESSION));
+    }
+
+    // Helper function to guess whether content is already compressed (media, archives, ...) by
+    // deflating a sample at the fastest level; such blobs are stored with zlib level 0
+    bool looksIncompressible(const char *data, size_t length)
+    {
+        if (length < 512 || !config.getBool("compression.detectIncompressible", true))
+            return false;
+        uLong sampleSize = min<size_t>(length, STREAM_CHUNK_SIZE);
+        vector<Bytef> scratch(compressBound(sampleSize));
+        uLongf compressedSize = scratch.size();
+        if (compress2(scratch.data(), &compressedSize, reinterpret_cast<const Bytef *>(data), sampleSize, 1) != Z_OK)
+            return false;
+        return compressedSize >= sampleSize * 95 / 100;
+    }
+
+    // Helper function to build the compressor for an object, given a sample of its content
+    unique_ptr<ObjectCompressor> makeCompressor(const string &type, const char *sample, size_t sampleLength)
+    {
+        // Chunks of a large blob are compressed with the blob settings
+        string kind = type == "chunk" ? "blob" : type;
+        if (kind == "blob" && looksIncompressible(sample, sampleLength))
+        {
+            return make_unique<ObjectCompressor>("zlib", Z_NO_COMPRESSION);
+        }
+        return make_unique<ObjectCompressor>(config.get("compression.codec", "zlib"), compressionLevel(kind));
+    }
+
+    // Helper function to compress data
+    string compressData(string_view data, const string &type = "blob")
+    {
+        TraceScope trace("compress", data.size());
+        string compressed;
+        auto sink = [&](const char *chunk, size_t length)
+        { compressed.append(chunk, length); };
+        unique_ptr<ObjectCompressor> compressor = makeCompressor(type, data.data(), data.size());
+        compressor->update(data.data(), data.size(), sink);
+        compressor->finish(sink);
+        return compressed;
+    }
+
+    // Helper function to decompress a zstd-compressed object
+    string decompressZstd(const unsigned char *data, size_t length)
+    {
+#ifdef MYGIT_WITH_ZSTD
+        ZSTD_DCtx *dctx = ZSTD_createDCtx();
+        if (!dctx)
+            throw runtime_error("ZSTD_createDCtx failed");
+        string decompressed;
+        char outbuffer[32768];
+        ZSTD_inBuffer input = {data, length, 0};
+        size_t ret = 1;
+        while (ret != 0 && input.pos < input.size)
+        {
+            ZSTD_outBuffer output = {outbuffer, sizeof(outbuffer), 0};
+            ret = ZSTD_decompressStream(dctx, &output, &input);
+            if (ZSTD_isError(ret))
+            {
+                ZSTD_freeDCtx(dctx);
+                throw runtime_error(string("zstd decompression failed: ") + ZSTD_getErrorName(ret));
+            }
+            decompressed.append(outbuffer, output.pos);
+        }
+        ZSTD_freeDCtx(dctx);
+        return decompressed;
+#else
+        (void)data;
+        (void)length;
+        throw runtime_error("object is zstd-compressed but mygit was built without zstd support (rebuild with ZSTD=1)");
+#endif
+    }
+
+    // Helper function to write object to storage
+    string writeObject(const string &content, const string &type)
+    {
+        TraceScope trace("write-object", content.size());
+        string header = type + " " + to_string(content.length()) + "$";
+        // header.push_back('$');
+        string store = header + content;
+        string sha = computeSHA1(store);
+
+        // Identical content is already stored: skip compressing and rewriting it
+        if (objectExists(sha))
+        {
+            dedupedWrites++;
+            return sha;
+        }
+
+        storeLooseObject(sha, store, type);
+        // cout<<"sha of file "<<filepath<<" is "<<sha<<endl;
+        return sha;
+    }
+
+    // Helper function to compress `store` (header and content) into the loose file for `sha`.
+    // The write is queued on the object writer, which goes through a temp file and a rename so a
+    // crash never leaves a truncated object that looks present
+    void storeLooseObject(const string &sha, const string &store, const string &type)
+    {
+        objectWriter->submit(sha, compressData(store, type));
+        markObjectWritten(sha);
+    }
+
+    // Helper function to store a large file as content-defined chunks plus a manifest listing
+    // "<chunk sha> <size>" per line. The manifest is stored under the blob's own ID `sha` (the
+    // hash of the whole content), so trees, the index and readers still see an ordinary blob;
+    // chunks shared with earlier versions of the file are not stored again.
+    void writeChunkedBlob(const string &filepath, const string &sha)
+    {
+        TraceScope trace("write-chunked-blob");
+        ifstream file(filepath, ios::binary);
+        if (!file.is_open())
+        {
+            throw runtime_error("Cannot open file: " + filepath);
+        }
+        ContentChunker chunker(config.getInt("chunking.averageSize", DEFAULT_CHUNK_AVERAGE));
+        string header = "blob " + to_string(fs::file_size(filepath)) + "$";
+        Sha1 sha1;
+        sha1.update(header.data(), header.size());
+
+        string buffer, manifest;
+        size_t pos = 0;
+        bool eof = false;
+        vector<char> inbuffer(STREAM_CHUNK_SIZE * 16);
+        while (true)
+        {
+            // Keep at least one maximum-size chunk buffered so every cut sees its whole range
+            while (!eof && buffer.size() - pos < chunker.maxChunkSize())
+            {
+                buffer.erase(0, pos);
+                pos = 0;
+                file.read(inbuffer.data(), inbuffer.size());
+                if (file.gcount() <= 0)
+                    eof = true;
+                else
+                    buffer.append(inbuffer.data(), file.gcount());
+            }
+            if (pos == buffer.size())
+                break;
+
+            size_t length = chunker.cut(reinterpret_cast<const unsigned char *>(buffer.data()) + pos, buffer.size() - pos);
+            string chunk = buffer.substr(pos, length);
+            sha1.update(chunk.data(), chunk.size());
+            manifest += writeObject(chunk, "chunk") + " " + to_string(length) + "\n";
+            tracer.count("chunks");
+            pos += length;
+        }
+        if (sha1.finish().hex() != sha)
+        {
+            throw runtime_error("File changed while hashing: " + filepath);
+        }
+        storeLooseObject(sha, "manifest " + to_string(manifest.size()) + "$" + manifest, "manifest");
+    }
+
+    // Helper function to list the chunks of a blob stored by writeChunkedBlob; false for any
+    // other object
+    bool readManifest(const string &sha, vector<pair<string, uint64_t>> &chunks)
+    {
+        string type;
+        uint64_t size;
+        if (!readLooseHeader(sha, type, size) || type != "manifest")
+            return false;
+        chunks = parseManifest(sha, loadStoredObject(sha)->content);
+        return true;
+    }
+
+    static vector<pair<string, uint64_t>> parseManifest(const string &sha, string_view content)
+    {
+        vector<pair<string, uint64_t>> chunks;
+        string_view line;
+        while (nextLine(content, line))
+        {
+            size_t space = line.find(' ');
+            if (space != 40)
+                throw runtime_error("Invalid manifest for " + sha);
+            chunks.emplace_back(string(line.substr(0, space)), stoull(string(line.substr(space + 1))));
+        }
+        return chunks;
+    }
+
+    // Helper function to pass the chunks of the blob `sha` to `sink` in order, one at a time, so
+    // the whole blob is never held in memory. Returns the blob's size.
+    uint64_t readChunks(const string &sha, const vector<pair<string, uint64_t>> &chunks,
+                        const function<void(string_view)> &sink)
+    {
+        uint64_t total = 0;
+        for (const auto &[chunkSha, size] : chunks)
+        {
+            shared_ptr<const ObjectCache::Entry> chunk = loadStoredObject(chunkSha);
+            if (chunk->type != "chunk" || chunk->content.size() != size)
+                throw runtime_error("Invalid chunk " + chunkSha + " in " + sha);
+            sink(chunk->content);
+            total += size;
+        }
+        return total;
+    }
+
+    // Helper function to check whether an object is already stored, loose or packed
+    bool objectExists(const string &sha)
+    {
+        ObjectId id = ObjectId::fromHex(sha);
+        {
+            lock_guard<mutex> guard(objectCacheLock);
+            if (knownObjects.count(id))
+                return true;
+            if (missingObjects.count(id))
+                return false;
+        }
+
+        bool exists = fs::exists(OBJECTS_DIR + "/" + sha.substr(0, 2) + "/" + sha.substr(2));
+        if (!exists)
+        {
+            uint64_t offset;
+            for (const auto &pack : *loadPacks())
+            {
+                if (pack->find(id.data(), offset))
+                {
+                    exists = true;
+                    break;
+                }
+            }
+        }
+
+        lock_guard<mutex> guard(objectCacheLock);
+        (exists ? knownObjects : missingObjects).insert(id);
+        return exists;
+    }
+
+    void markObjectWritten(const string &sha)
+    {
+        ObjectId id = ObjectId::fromHex(sha);
+        objectsWritten++;
+        objectWriter->noteWrite();
+        lock_guard<mutex> guard(objectCacheLock);
+        missingObjects.erase(id);
+        knownObjects.insert(id);
+    }
+
+    // Helper function to hash (and optionally store) a file as a blob in fixed-size chunks,
+    // so peak memory stays constant regardless of the file size.
+    // The compressed object goes to a temp file that is renamed into place once the SHA is known.
+    string streamBlob(const string &filepath, bool write, uintmax_t *bytesRead = nullptr)
+    {
+        ifstream file(filepath, ios::binary);
+        if (!file.is_open())
+        {
+            throw runtime_error("Cannot open file: " + filepath);
+        }
+
+        uintmax_t expectedSize = fs::file_size(filepath);
+        string header = "blob " + to_string(expectedSize) + "$";
+
+        Sha1 sha1;
+        sha1.update(header.data(), header.size());
+
+        int fd = -1;
+        string tempPath;
+        unique_ptr<ObjectCompressor> compressor;
+        auto sink = [&](const char *data, size_t length)
+        { writeAll(fd, data, length); };
+
+        try
+        {
+            if (write)
+            {
+                createDirectory(OBJECTS_DIR);
+                fd = createTempFile(OBJECTS_DIR + "/tmp_obj_", tempPath);
+                if (fd < 0)
+                {
+                    throw runtime_error("Cannot create temporary object file in " + OBJECTS_DIR);
+                }
+            }
+
+            vector<char> inbuffer(STREAM_CHUNK_SIZE);
+            uintmax_t totalRead = 0;
+            while (file)
+            {
+                file.read(inbuffer.data(), inbuffer.size());
+                streamsize got = file.gcount();
+                if (got <= 0)
+                    break;
+                totalRead += got;
+                sha1.update(inbuffer.data(), got);
+                if (write)
+                {
+                    // The first chunk doubles as the sample for incompressible-content detection
+                    if (!compressor)
+                    {
+                        compressor = makeCompressor("blob", inbuffer.data(), got);
+                        compressor->update(header.data(), header.size(), sink);
+                    }
+                    compressor->update(inbuffer.data(), got, sink);
+                }
+            }
+            file.close();
+
+            if (totalRead != expectedSize)
+            {
+                throw runtime_error("File changed while hashing: " + filepath);
+            }
+            if (bytesRead)
+            {
+                *bytesRead = totalRead;
+            }
+
+            string sha = sha1.finish().hex();
+
+            if (write)
+            {
+                if (!compressor)
+                {
+                    compressor = makeCompressor("blob", nullptr, 0);
+                    compressor->update(header.data(), header.size(), sink);
+                }
+                compressor->finish(sink);
+                compressor.reset();
+                if (close(fd) != 0)
+                {
+                    fd = -1;
+                    throw runtime_error(string("close failed: ") + strerror(errno));
+                }
+                fd = -1;
+
+                string objectPath = OBJECTS_DIR + "/" + sha.substr(0, 2);
+                createDirectory(objectPath);
+                string finalPath = objectPath + "/" + sha.substr(2);
+                if (rename(tempPath.c_str(), finalPath.c_str()) != 0)
+                {
+                    throw runtime_error("Cannot move object into place: " + finalPath);
+                }
+                tempPath.clear();
+                markObjectWritten(sha);
+            }
+            return sha;
+        }
+        catch (...)
+        {
+            if (fd >= 0)
+            {
+                close(fd);
+            }
+            if (!tempPath.empty())
+            {
+                unlink(tempPath.c_str());
+            }
+            throw;
+        }
+    }
+
+    // Packs under objects/pack, loaded on the first lookup that misses the loose object store.
+    // The list is replaced rather than modified, so a snapshot stays valid while it is read.
+    using PackList = vector<shared_ptr<PackFile>>;
+    shared_ptr<const PackList> packs = make_shared<PackList>();
+    bool packsLoaded = false;
+    mutex packsLock;
+
+    // Longest delta chain gc will build; reads resolve chains recursively
+    static constexpr int MAX_DELTA_DEPTH = 50;
+    // Number of preceding objects gc tries as delta bases for each object
+    static constexpr size_t DELTA_WINDOW = 10;
+    // Objects larger than this are stored whole rather than delta-searched
+    static constexpr size_t MAX_DELTA_SOURCE = 32 * 1024 * 1024;
+
+    // Helper function to map every pack in objects/pack that is not mapped yet; packsLock must be
+    // held. Returns true when a new pack was found.
+    bool scanPacks()
+    {
+        packsLoaded = true;
+        string packDir = OBJECTS_DIR + "/pack";
+        if (!fs::is_directory(packDir))
+            return false;
+        auto list = make_shared<PackList>(*packs);
+        for (const auto &entry : fs::directory_iterator(packDir))
+        {
+            if (entry.path().extension() != ".idx")
+                continue;
+            fs::path packPath = entry.path();
+            packPath.replace_extension(".pack");
+            if (any_of(list->begin(), list->end(), [&](const shared_ptr<PackFile> &pack)
+                       { return pack->packPath == packPath.string(); }))
+                continue;
+            try
+            {
+                list->push_back(make_shared<PackFile>(entry.path().string(), packPath.string()));
+            }
+            catch (const exception &e)
+            {
+                cerr << "Warning: ignoring pack: " << e.what() << endl;
+            }
+        }
+        if (list->size() == packs->size())
+            return false;
+        packs = move(list);
+        return true;
+    }
+
+    // Helper function to map every pack in objects/pack on first use and return the current list
+    shared_ptr<const PackList> loadPacks()
+    {
+        lock_guard<mutex> guard(packsLock);
+        if (!packsLoaded)
+            scanPacks();
+        return packs;
+    }
+
+    // Helper function to pick up packs written since the list was loaded, e.g. by a gc in another
+    // process that also removed the loose copies. Called once before a read reports a missing object.
+    bool rescanPacks()
+    {
+        {
+            lock_guard<mutex> guard(packsLock);
+            if (!scanPacks())
+                return false;
+        }
+        tracer.count("pack.rescans");
+        lock_guard<mutex> guard(objectCacheLock);
+        missingObjects.clear();
+        return true;
+    }
+
+    // Helper function to inflate a zlib stream starting at `data` that must produce exactly `size` bytes
+    string inflateExact(const unsigned char *data, size_t available, size_t size)
+    {
+        TraceScope trace("inflate", size);
+        if (ObjectCompressor::isZstdFrame(data, available))
+        {
+#ifdef MYGIT_WITH_ZSTD
+            size_t frameSize = ZSTD_findFrameCompressedSize(data, available);
+            if (ZSTD_isError(frameSize))
+                throw runtime_error("Corrupt packed object: bad zstd frame");
+            string out(size, '\0');
+            size_t produced = ZSTD_decompress(out.data(), size, data, frameSize);
+            if (ZSTD_isError(produced) || produced != size)
+                throw runtime_error("Corrupt packed object: zstd size mismatch");
+            return out;
+#else
+            return decompressZstd(data, available);
+#endif
+        }
+
+        z_stream zs;
+        memset(&zs, 0, sizeof(zs));
+        if (inflateInit(&zs) != Z_OK)
+        {
+            throw runtime_error("inflateInit failed");
+        }
+
+        // One spare byte so an empty object can still reach Z_STREAM_END
+        string out(size + 1, '\0');
+        zs.next_in = (Bytef *)data;
+        zs.avail_in = min<size_t>(available, UINT_MAX);
+        zs.next_out = reinterpret_cast<Bytef *>(out.data());
+        zs.avail_out = out.size();
+        int ret = inflate(&zs, Z_FINISH);
+        size_t produced = zs.total_out;
+        inflateEnd(&zs);
+        if (ret != Z_STREAM_END || produced != size)
+        {
+            throw runtime_error("inflate failed: corrupt packed object");
+        }
+        out.resize(size);
+        return out;
+    }
+
+    // Helper function to read the entry at `offset` in `pack`, resolving delta chains against their
+    // bases. The chain is walked down to a cached or whole base, then its deltas are applied back up
+    // and each intermediate result is cached, so the next object of the same chain starts from there.
+    pair<int, string> readPackEntry(const PackFile &pack, uint64_t offset)
+    {
+        TraceScope trace("pack.read-entry");
+        const unsigned char *start = pack.data();
+        const unsigned char *end = start + pack.length() - SHA_DIGEST_LENGTH;
+
+        struct PendingDelta
+        {
+            uint64_t offset;
+            const unsigned char *data;
+            uint64_t size;
+        };
+        vector<PendingDelta> deltas; // outermost first
+        shared_ptr<const pair<int, string>> base;
+        while (true)
+        {
+            if (!deltas.empty() && (base = pack.cachedBase(offset)))
+            {
+                tracer.count("pack.base-cache-hits");
+                break;
+            }
+            const unsigned char *cursor = start + offset;
+            if (offset < 12 || cursor >= end)
+            {
+                throw runtime_error("Corrupt pack: bad object offset in " + pack.packPath);
+            }
+
+            unsigned char c = *cursor++;
+            int type = (c >> 4) & 7;
+            uint64_t size = c & 0x0f;
+            int shift = 4;
+            while (c & 0x80)
+            {
+                if (cursor >= end)
+                    throw runtime_error("Corrupt pack: truncated object header");
+                c = *cursor++;
+                size |= uint64_t(c & 0x7f) << shift;
+                shift += 7;
+            }
+
+            if (type != PackFile::OBJ_OFS_DELTA)
+            {
+                if (deltas.empty())
+                    return {type, inflateExact(cursor, end - cursor, size)};
+                base = make_shared<const pair<int, string>>(type, inflateExact(cursor, end - cursor, size));
+                pack.cacheBase(offset, base);
+                break;
+            }
+
+            if (cursor >= end)
+                throw runtime_error("Corrupt pack: truncated delta offset");
+            c = *cursor++;
+            uint64_t distance = c & 0x7f;
+            while (c & 0x80)
+            {
+                if (cursor >= end)
+                    throw runtime_error("Corrupt pack: truncated delta offset");
+                c = *cursor++;
+                distance = ((distance + 1) << 7) | (c & 0x7f);
+            }
+            if (distance == 0 || distance > offset)
+            {
+                throw runtime_error("Corrupt pack: bad delta base in " + pack.packPath);
+            }
+            deltas.push_back({offset, cursor, size});
+            offset -= distance;
+        }
+
+        auto applyDelta = [&](const PendingDelta &pending)
+        {
+            string delta = inflateExact(pending.data, end - pending.data, pending.size);
+            return Delta::apply(base->second, reinterpret_cast<const unsigned char *>(delta.data()), delta.size());
+        };
+        for (size_t i = deltas.size() - 1; i > 0; i--)
+        {
+            base = make_shared<const pair<int, string>>(base->first, applyDelta(deltas[i]));
+            pack.cacheBase(deltas[i].offset, base);
+        }
+        return {base->first, applyDelta(deltas[0])};
+    }
+
+    // Helper function to look an object up in the packs; returns false when no pack has it
+    bool readPackedObject(const string &sha, pair<string, string> &object)
+    {
+        ObjectId id;
+        if (!ObjectId::parseHex(sha, id))
+            return false;
+        for (const auto &pack : *loadPacks())
+        {
+            uint64_t offset;
+            if (pack->find(id.data(), offset))
+            {
+                auto [type, content] = readPackEntry(*pack, offset);
+                object = {packTypeName(type), move(content)};
+                return true;
+            }
+        }
+        return false;
+    }
+
+    static string packTypeName(int type)
+    {
+        switch (type)
+        {
+        case PackFile::OBJ_COMMIT:
+            return "commit";
+        case PackFile::OBJ_TREE:
+            return "tree";
+        case PackFile::OBJ_BLOB:
+            return "blob";
+        default:
+            throw runtime_error("Corrupt pack: unknown object type " + to_string(type));
+        }
+    }
+
+    static int packTypeCode(const string &type)
+    {
+        if (type == "commit")
+            return PackFile::OBJ_COMMIT;
+        if (type == "tree")
+            return PackFile::OBJ_TREE;
+        if (type == "blob")
+            return PackFile::OBJ_BLOB;
+        throw runtime_error("Cannot pack object of type " + type);
+    }
+
+    // Helper function to list the SHAs of all loose objects (objects/xx/yyyy...)
+    vector<string> listLooseObjects()
+    {
+        objectWriter->drain();
+        vector<string> shas;
+        if (!fs::is_directory(OBJECTS_DIR))
+            return shas;
+        for (const auto &dir : fs::directory_iterator(OBJECTS_DIR))
+        {
+            string prefix = dir.path().filename().string();
+            if (!dir.is_directory() || prefix.size() != 2 || !isxdigit(prefix[0]) || !isxdigit(prefix[1]))
+                continue;
+            for (const auto &file : fs::directory_iterator(dir.path()))
+            {
+                string rest = file.path().filename().string();
+                if (rest.size() == 2 * SHA_DIGEST_LENGTH - 2)
+                    shas.push_back(prefix + rest);
+            }
+        }
+        return shas;
+    }
+
+    // Helper function to remember a path name for each tree and blob reachable from HEAD,
+    // so gc can place successive versions of the same file next to each other
+    void collectPathHints(map<string, string> &hints)
+    {
+        set<string> visitedTrees;
+        function<void(const string &, const string &)> walkTree = [&](const string &treeSha, const string &prefix)
+        {
+            if (!visitedTrees.insert(treeSha).second)
+                return;
+            for (const auto &[mode, objectType, sha, name] : parseTree(treeSha))
+            {
+                hints.emplace(sha, prefix + name);
+                if (objectType == "tree")
+                    walkTree(sha, prefix + name + "/");
+            }
+        };
+
+        try
+        {
+            string commit = readHead();
+            set<string> visitedCommits;
+            while (!commit.empty() && visitedCommits.insert(commit).second)
+            {
+                ObjectView object = viewObject(commit);
+                string_view rest = object.content(), line;
+                string parent;
+                while (nextLine(rest, line) && !line.empty())
+                {
+                    if (line.rfind("tree ", 0) == 0)
+                        walkTree(string(line.substr(5)), "");
+                    else if (line.rfind("parent ", 0) == 0)
+                        parent = string(line.substr(7));
+                }
+                commit = parent;
+            }
+        }
+        catch (const exception &e)
+        {
+            // Hints only improve delta selection; a broken history still gets packed
+            cerr << "Warning: incomplete history walk during gc: " << e.what() << endl;
+        }
+    }
+
+    // Helper function to read an object without copying it: the view shares the inflated buffer
+    // with the object cache
+    ObjectView viewObject(const string &sha)
+    {
+        TraceScope trace("read-object");
+        ObjectId id;
+        if (!ObjectId::parseHex(sha, id))
+        {
+            throw runtime_error("Object not found: " + sha);
+        }
+        shared_ptr<const ObjectCache::Entry> cached = objectCache.get(id);
+        if (!cached)
+        {
+            cached = loadObject(sha);
+            objectCache.put(id, cached);
+        }
+        trace.addBytes(cached->content.size());
+        return ObjectView(move(cached));
+    }
+
+    // Helper function to read and inflate an object from the loose store or a pack, bypassing the cache
+    shared_ptr<const ObjectCache::Entry> loadObject(const string &sha)
+    {
+        shared_ptr<const ObjectCache::Entry> stored = loadStoredObject(sha);
+        if (stored->type != "manifest")
+            return stored;
+
+        // A chunked blob: reassemble it from its chunks
+        vector<pair<string, uint64_t>> chunks = parseManifest(sha, stored->content);
+        auto blob = make_shared<ObjectCache::Entry>();
+        blob->type = "blob";
+        uint64_t total = 0;
+        for (const auto &chunk : chunks)
+            total += chunk.second;
+        blob->content.reserve(total);
+        readChunks(sha, chunks, [&](string_view chunk)
+                   { blob->content += chunk; });
+        return blob;
+    }
+
+    // Helper function to open a loose object file. An object written earlier in this command may
+    // still be queued on the object writer, so a miss waits for the queue and tries again.
+    int openLooseObject(const string &objectPath)
+    {
+        int fd = open(objectPath.c_str(), O_RDONLY);
+        if (fd < 0 && objectWriter->busy())
+        {
+            objectWriter->drain();
+            fd = open(objectPath.c_str(), O_RDONLY);
+        }
+        return fd;
+    }
+
+    // Helper function to load an object exactly as stored, without reassembling chunked blobs
+    shared_ptr<const ObjectCache::Entry> loadStoredObject(const string &sha)
+    {
+        TraceScope trace("load-object");
+        string objectPath = OBJECTS_DIR + "/" + sha.substr(0, 2) + "/" + sha.substr(2);
+        int fd = openLooseObject(objectPath);
+        if (fd < 0)
+        {
+            // Not loose; after gc it may live in a pack
+            pair<string, string> packed;
+            if (readPackedObject(sha, packed) || (rescanPacks() && readPackedObject(sha, packed)))
+            {
+                return make_shared<const ObjectCache::Entry>(ObjectCache::Entry{move(packed.first), move(packed.second)});
+            }
+            throw runtime_error("Object not found: " + sha);
+        }
+
+        struct stat st;
+        if (fstat(fd, &st) != 0 || st.st_size == 0)
+        {
+            close(fd);
+            throw runtime_error("Invalid object format");
+        }
+        void *mapped = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (mapped == MAP_FAILED)
+        {
+            throw runtime_error("Cannot mmap object: " + objectPath);
+        }
+
+        auto entry = make_shared<ObjectCache::Entry>();
+        try
+        {
+            inflateLooseObject(static_cast<const unsigned char *>(mapped), st.st_size, *entry);
+        }
+        catch (...)
+        {
+            munmap(mapped, st.st_size);
+            throw;
+        }
+        munmap(mapped, st.st_size);
+        return entry;
+    }
+
+    // Helper function returning this thread's zlib inflate stream, reset for a new object.
+    // Keeping one per thread avoids an inflateInit/inflateEnd allocation pair on every read.
+    static z_stream &threadInflater()
+    {
+        struct Inflater
+        {
+            z_stream zs;
+            Inflater()
+            {
+                memset(&zs, 0, sizeof(zs));
+                if (inflateInit(&zs) != Z_OK)
+                    throw runtime_error("inflateInit failed");
+            }
+            ~Inflater() { inflateEnd(&zs); }
+        };
+        thread_local Inflater inflater;
+        inflateReset(&inflater.zs);
+        return inflater.zs;
+    }
+
+    // Helper function to split a loose object header ("<type> <size>", without the '$') into its
+    // fields. The size must be plain decimal digits with nothing after them.
+    static bool parseObjectHeader(string_view header, string &type, uint64_t &size)
+    {
+        size_t space = header.find(' ');
+        if (space == string_view::npos || space == 0)
+            return false;
+        const char *digits = header.data() + space + 1;
+        const char *end = header.data() + header.size();
+        auto [stop, error] = from_chars(digits, end, size);
+        if (error != errc() || stop != end || digits == end)
+            return false;
+        type = string(header.substr(0, space));
+        return true;
+    }
+
+    // Helper function to inflate a loose object ("<type> <size>$<content>") into `entry`. Only the
+    // header is inflated into a scratch buffer; the content is inflated straight into a string
+    // sized from the header.
+    void inflateLooseObject(const unsigned char *data, size_t length, ObjectCache::Entry &entry)
+    {
+        TraceScope trace("inflate");
+        if (ObjectCompressor::isZstdFrame(data, length))
+        {
+            string decompressed = decompressZstd(data, length);
+            size_t headerEnd = decompressed.find('$');
+            if (headerEnd == string::npos)
+                throw runtime_error("Invalid object format");
+            uint64_t size;
+            if (!parseObjectHeader(string_view(decompressed).substr(0, headerEnd), entry.type, size))
+                throw runtime_error("Invalid object format");
+            if (size != decompressed.size() - headerEnd - 1)
+                throw runtime_error("Invalid object format: size mismatch");
+            decompressed.erase(0, headerEnd + 1);
+            entry.content = move(decompressed);
+            trace.addBytes(entry.content.size());
+            return;
+        }
+
+        z_stream &zs = threadInflater();
+        zs.next_in = const_cast<Bytef *>(data);
+        zs.avail_in = min<size_t>(length, UINT_MAX);
+
+        // Headers are short ("commit 1234$"); anything longer than this is not an object
+        char header[64];
+        zs.next_out = reinterpret_cast<Bytef *>(header);
+        zs.avail_out = sizeof(header);
+        const char *headerEnd = nullptr;
+        int ret = Z_OK;
+        while (!headerEnd)
+        {
+            ret = inflate(&zs, Z_SYNC_FLUSH);
+            if (ret != Z_OK && ret != Z_STREAM_END)
+                throw runtime_error("inflate failed");
+            headerEnd = static_cast<const char *>(memchr(header, '$', zs.total_out));
+            if (!headerEnd && (ret == Z_STREAM_END || zs.avail_out == 0))
+                throw runtime_error("Invalid object format");
+        }
+
+        uint64_t size;
+        if (!parseObjectHeader(string_view(header, headerEnd - header), entry.type, size))
+            throw runtime_error("Invalid object format");
+        // Deflate expands by at most 1032:1, so a larger size is a lie; don't allocate for it
+        if (size > (uint64_t(length) + 1) * 1032)
+            throw runtime_error("Invalid object format: size mismatch");
+
+        // Content bytes already inflated past the header go first; one spare byte lets a
+        // too-long stream be detected instead of silently truncated
+        size_t already = zs.total_out - (headerEnd + 1 - header);
+        entry.content.resize(size + 1);
+        if (already > size)
+            throw runtime_error("Invalid object format: size mismatch");
+        memcpy(entry.content.data(), headerEnd + 1, already);
+        if (ret != Z_STREAM_END)
+        {
+            zs.next_out = reinterpret_cast<Bytef *>(entry.content.data() + already);
+            zs.avail_out = size + 1 - already;
+            ret = inflate(&zs, Z_FINISH);
+            if (ret != Z_STREAM_END)
+                throw runtime_error(zs.avail_out == 0 ? "Invalid object format: size mismatch" : "inflate failed");
+            already = size + 1 - zs.avail_out;
+        }
+        if (already != size)
+            throw runtime_error("Invalid object format: size mismatch");
+        entry.content.resize(size);
+        trace.addBytes(size);
+    }
+
+    // Helper function to read only the type and size of a loose object from the start of its file.
+    // False when the object is not loose or looks damaged (or is zstd-compressed and this build has
+    // no zstd); the caller then loads it in full, which also reports the error properly.
+    bool readLooseHeader(const string &sha, string &type, uint64_t &size)
+    {
+        string objectPath = OBJECTS_DIR + "/" + sha.substr(0, 2) + "/" + sha.substr(2);
+        int fd = openLooseObject(objectPath);
+        if (fd < 0)
+            return false;
+        unsigned char data[1024];
+        ssize_t length = pread(fd, data, sizeof(data), 0);
+        char header[64];
+        size_t produced = 0;
+        if (length > 0 && ObjectCompressor::isZstdFrame(data, length))
+        {
+#ifdef MYGIT_WITH_ZSTD
+            // zstd emits nothing until a whole block has arrived, so keep reading until the header does
+            unique_ptr<ZSTD_DCtx, size_t (*)(ZSTD_DCtx *)> dctx(ZSTD_createDCtx(), ZSTD_freeDCtx);
+            ZSTD_outBuffer output = {header, sizeof(header), 0};
+            off_t offset = 0;
+            while (dctx && length > 0 && output.pos < output.size && !memchr(header, '$', output.pos))
+            {
+                ZSTD_inBuffer input = {data, size_t(length), 0};
+                while (input.pos < input.size && output.pos < output.size && !memchr(header, '$', output.pos))
+                {
+                    if (ZSTD_isError(ZSTD_decompressStream(dctx.get(), &output, &input)))
+                    {
+                        close(fd);
+                        return false;
+                    }
+                }
+                offset += length;
+                length = pread(fd, data, sizeof(data), offset);
+            }
+            produced = output.pos;
+#endif
+        }
+        else if (length > 0)
+        {
+            z_stream &zs = threadInflater();
+            zs.next_in = data;
+            zs.avail_in = length;
+            zs.next_out = reinterpret_cast<Bytef *>(header);
+            zs.avail_out = sizeof(header);
+            while (zs.avail_out > 0 && !memchr(header, '$', zs.total_out))
+            {
+                int ret = inflate(&zs, Z_SYNC_FLUSH);
+                if (ret != Z_OK || zs.avail_in == 0)
+                    break;
+            }
+            produced = zs.total_out;
+        }
+        close(fd);
+        const char *headerEnd = static_cast<const char *>(memchr(header, '$', produced));
+        if (!headerEnd)
+            return false;
+
+        return parseObjectHeader(string_view(header, headerEnd - header), type, size);
+    }
+
+    // Helper function to join lines with a separator
+    string joinLines(const vector<string> &lines, size_t start, size_t end)
+    {
+        string result;
+        for (size_t i = start; i < end; ++i)
+        {
+            result += lines[i];
+            if (i < end - 1)
+            {
+                result += "\n";
+            }
+        }
+        return result;
+    }
+
+    // Helper function to parse timestamp
+    time_t parseTimestamp(const string &timestampStr)
+    {
+        try
+        {
+            return stol(timestampStr);
+        }
+        catch (const invalid_argument &e)
+        {
+            cerr << "Error: Invalid timestamp format in commit object." << endl;
+            return 0;
+        }
+    }
+
+    // Cached SHA of a directory's tree, valid while none of its entryCount index entries change
+    struct CacheTreeEntry
+    {
+        uint32_t entryCount;
+        string sha;
+    };
+
+    // Helper function to decode the index "TREE" extension: per directory, "path\0" | count u32 | raw SHA
+    map<string, CacheTreeEntry> parseCacheTree(const string &payload)
+    {
+        map<string, CacheTreeEntry> cache;
+        size_t pos = 0;
+        while (pos < payload.size())
+        {
+            size_t nul = payload.find('\0', pos);
+            if (nul == string::npos || nul + 5 + SHA_DIGEST_LENGTH > payload.size())
+                break; // Truncated extension: treat the remainder as invalid
+            const unsigned char *fields = reinterpret_cast<const unsigned char *>(payload.data()) + nul + 1;
+            cache[payload.substr(pos, nul - pos)] = {getBE32(fields), rawToHex(fields + 4)};
+            pos = nul + 5 + SHA_DIGEST_LENGTH;
+        }
+        return cache;
+    }
+
+    string serializeCacheTree(const map<string, CacheTreeEntry> &cache)
+    {
+        string payload;
+        for (const auto &[dir, entry] : cache)
+        {
+            payload += dir;
+            payload.push_back('\0');
+            putBE32(payload, entry.entryCount);
+            payload += hexToRaw(entry.sha);
+        }
+        return payload;
+    }
+
+    // Helper function to drop the cached trees of the root and every directory containing `path`
+    void invalidateCacheTree(map<string, CacheTreeEntry> &cache, const string &path)
+    {
+        cache.erase("");
+        for (size_t slash = path.find('/'); slash != string::npos; slash = path.find('/', slash + 1))
+        {
+            cache.erase(path.substr(0, slash));
+        }
+    }
+
+    // Helper function to write the tree for entries[begin, end), which all live under `dir`.
+    // Directories with a valid cached SHA are reused without reading or hashing anything.
+    string writeTreeRange(const vector<IndexEntry> &entries, size_t begin, size_t end, const string &dir,
+                          map<string, CacheTreeEntry> &cache, size_t &treesWritten)
+    {
+        auto cached = cache.find(dir);
+        if (cached != cache.end() && cached->second.entryCount == end - begin)
+        {
+            return cached->second.sha;
+        }
+
+        size_t prefixLength = dir.empty() ? 0 : dir.size() + 1;
+        stringstream treeContent;
+        size_t i = begin;
+        while (i < end)
+        {
+            const string &path = entries[i].path;
+            size_t slash = path.find('/', prefixLength);
+            if (slash == string::npos)
+            {
+                treeContent << oct << setw(6) << setfill('0') << entries[i].mode << dec
+                            << " blob " << entries[i].sha << " " << path.substr(prefixLength) << "\n";
+                i++;
+                continue;
+            }
+
+            // Paths sharing a directory prefix are contiguous in the sorted index
+            string childDir = path.substr(0, slash);
+            string childPrefix = childDir + "/";
+            size_t j = i;
+            while (j < end && entries[j].path.compare(0, childPrefix.size(), childPrefix) == 0)
+                j++;
+            string childSha = writeTreeRange(entries, i, j, childDir, cache, treesWritten);
+            treeContent << "040000 tree " << childSha << " " << childDir.substr(prefixLength) << "\n";
+            i = j;
+        }
+
+        string sha = writeObject(treeContent.str(), "tree");
+        treesWritten++;
+        cache[dir] = {static_cast<uint32_t>(end - begin), sha};
+        return sha;
+    }
+
+    // Helper function to sort `paths` and drop the ones that lie under another listed path,
+    // so each changed directory is examined once
+    static vector<string> outermostPaths(vector<string> paths)
+    {
+        sort(paths.begin(), paths.end());
+        paths.erase(unique(paths.begin(), paths.end()), paths.end());
+        vector<string> result;
+        for (const string &path : paths)
+        {
+            if (!isUnder(result, path))
+                result.push_back(path);
+        }
+        return result;
+    }
+
+    // True when `path` is one of the sorted `roots` or lies below one of them ("" is the whole tree)
+    static bool isUnder(const vector<string> &roots, const string &path)
+    {
+        if (binary_search(roots.begin(), roots.end(), "") || binary_search(roots.begin(), roots.end(), path))
+            return true;
+        for (size_t slash = path.find('/'); slash != string::npos; slash = path.find('/', slash + 1))
+        {
+            if (binary_search(roots.begin(), roots.end(), path.substr(0, slash)))
+                return true;
+        }
+        return false;
+    }
+
+    // Helper function to ask the fsmonitor daemon what changed since the token stored in the
+    // index. Without core.fsmonitor or a running daemon the result asks for a full scan.
+    FsMonitor::Changes queryFsMonitor(const IndexFile &index)
+    {
+        if (!config.getBool("core.fsmonitor", false))
+            return {};
+        return FsMonitor(WORK_TREE, GIT_DIR_NAME).query(index.extension("FSMN"));
+    }
+
+    // Helper function to build the index extensions: the cached trees plus, when set, the
+    // fsmonitor token the working tree was last fully compared at
+    map<string, string> indexExtensions(const map<string, CacheTreeEntry> &cacheTree, const string &fsmonitorToken)
+    {
+        map<string, string> extensions = {{"TREE", serializeCacheTree(cacheTree)}};
+        if (!fsmonitorToken.empty())
+            extensions["FSMN"] = fsmonitorToken;
+        return extensions;
+    }
+
+public:
+    // Helper function to make `root` absolute and normal, without a trailing slash ("" for "/")
+    static string absoluteRoot(const string &root)
+    {
+        string path = fs::absolute(root).lexically_normal().string();
+        while (!path.empty() && path.back() == '/')
+            path.pop_back();
+        return path;
+    }
+
+    // Operations take and return paths relative to `root`, whatever the process working directory is
+    explicit MyGit(const string &root) : WORK_TREE(absoluteRoot(root))
+    {
+        config.load(CONFIG_PATH);
+        long long cacheSize = config.getInt("core.objectCacheSize", DEFAULT_OBJECT_CACHE_SIZE);
+        if (cacheSize < 0)
+        {
+            cerr << "Warning: core.objectCacheSize is negative; the object cache is disabled" << endl;
+            cacheSize = 0;
+        }
+        objectCache.setCapacity(cacheSize);
+        string writer = config.get("core.objectWriter", "io_uring");
+        objectWriter = make_unique<ObjectWriter>(OBJECTS_DIR, writer == "sync"      ? ObjectWriter::Backend::Sync
+                                                              : writer == "threads" ? ObjectWriter::Backend::Threads
+                                                                                    : ObjectWriter::Backend::IoUring);
+    }
+
+    ~MyGit()
+    {
+        // Object store and cache totals for MYGIT_TRACE
+        if (!tracer.enabled())
+            return;
+        ObjectCache::Stats stats = objectCache.stats();
+        tracer.count("object-cache.hits", stats.hits);
+        tracer.count("object-cache.misses", stats.misses);
+        tracer.count("object-cache.evictions", stats.evictions);
+        tracer.count("objects.written", objectsWritten);
+        tracer.count("objects.deduplicated", dedupedWrites);
+    }
+
+    // The durability barrier: every object written so far is in place, and on disk unless
+    // core.fsyncObjects is false. Run once per command, before the index or HEAD refers to them.
+    void syncObjects()
+    {
+        objectWriter->sync(config.getBool("core.fsyncObjects", true));
+    }
+
+    // Hit/miss counters of the shared object cache
+    ObjectCache::Stats objectCacheStats() const
+    {
+        return objectCache.stats();
+    }
+
+    // Cat file command: the object's type and content, shared with the object cache
+    ObjectView catFile(const string &sha)
+    {
+        return viewObject(sha);
+    }
+
+    // Cat file command for output: passes the content to `sink` and returns the type and size. A
+    // chunked blob is passed one chunk at a time instead of being reassembled in memory.
+    ObjectInfo streamObject(const string &sha, const function<void(string_view)> &sink)
+    {
+        vector<pair<string, uint64_t>> chunks;
+        if (readManifest(sha, chunks))
+        {
+            TraceScope trace("cat-file.stream-chunks");
+            uint64_t size = readChunks(sha, chunks, sink);
+            trace.addBytes(size);
+            return {"blob", size, true};
+        }
+        ObjectView object = viewObject(sha);
+        sink(object.content());
+        return {object.type(), object.size()};
+    }
+
+    // Batch cat-file: reads `shas` on `jobs` threads so inflating overlaps. Names that are not
+    // an object ID, and objects that do not exist, come back as null; corrupt objects throw.
+    vector<shared_ptr<const ObjectCache::Entry>> catFiles(const vector<string> &shas, unsigned jobs = 0)
+    {
+        TraceScope trace("cat-file-batch");
+        vector<shared_ptr<const ObjectCache::Entry>> objects(shas.size());
+        runParallel(shas.size(), resolveJobCount(jobs), [&](size_t i)
+                    {
+            ObjectId id;
+            if (!ObjectId::parseHex(shas[i], id))
+                return;
+            try
+            {
+                objects[i] = viewObject(shas[i]).buffer();
+            }
+            catch (const exception &)
+            {
+                if (objectExists(shas[i]))
+                    throw;
+            } });
+        return objects;
+    }
+
+    // Batch cat-file without content: type and size per object (empty type when missing). Loose
+    // objects only have their header inflated unless they are already cached.
+    vector<ObjectInfo> catFileHeaders(const vector<string> &shas, unsigned jobs = 0)
+    {
+        TraceScope trace("cat-file-batch-check");
+        vector<ObjectInfo> headers(shas.size());
+        runParallel(shas.size(), resolveJobCount(jobs), [&](size_t i)
+                    {
+            ObjectId id;
+            if (!ObjectId::parseHex(shas[i], id))
+                return;
+            if (shared_ptr<const ObjectCache::Entry> cached = objectCache.get(id))
+            {
+                headers[i] = {cached->type, cached->content.size()};
+                return;
+            }
+            if (readLooseHeader(shas[i], headers[i].type, headers[i].size))
+            {
+                // A chunked blob's size is the sum of its chunks
+                vector<pair<string, uint64_t>> chunks;
+                if (headers[i].type == "manifest" && readManifest(shas[i], chunks))
+                {
+                    headers[i] = {"blob", 0, true};
+                    for (const auto &chunk : chunks)
+                        headers[i].size += chunk.second;
+                }
+                return;
+            }
+            try
+            {
+                ObjectView object = viewObject(shas[i]);
+                headers[i] = {object.type(), object.size()};
+            }
+            catch (const exception &)
+            {
+                if (objectExists(shas[i]))
+                    throw;
+            } });
+        return headers;
+    }
+
+    // Initialize repository
+    void init()
+    {
+        if (fs::exists(GIT_DIR))
+        {
+            throw runtime_error("Repository already exists");
+        }
+
+        if (!createDirectory(GIT_DIR) || !createDirectory(OBJECTS_DIR))
+        {
+            throw runtime_error("Cannot create " + GIT_DIR);
+        }
+        // Start from the historical defaults; see README for the available keys
+        ofstream configFile(CONFIG_PATH);
+        configFile << "[compression]\n"
+                   << "\tlevel = " << Z_BEST_COMPRESSION << "\n"
+                   << "\tcodec = zlib\n"
+                   << "\tdetectIncompressible = true\n";
+        configFile.close();
+        config.load(CONFIG_PATH);
+    }
+
+    // Hash object command
+    string hashObject(const string &path, bool write = false, uintmax_t *bytesRead = nullptr)
+    {
+        TraceScope trace("hash-object");
+        string filepath = workPath(path);
+        if (!write)
+        {
+            return streamBlob(filepath, false, bytesRead);
+        }
+
+        // Small files are read once; writeObject checks for an existing copy before compressing
+        if (fs::file_size(filepath) <= SMALL_BLOB_LIMIT)
+        {
+            ifstream file(filepath, ios::binary);
+            if (!file.is_open())
+            {
+                throw runtime_error("Cannot open file: " + filepath);
+            }
+            string content((istreambuf_iterator<char>(file)), istreambuf_iterator<char>());
+            if (bytesRead)
+            {
+                *bytesRead = content.size();
+            }
+            return writeObject(content, "blob");
+        }
+
+        // Large blobs are streamed so they never have to fit in memory: hash first, and
+        // only run the compressing pass when the object is not stored yet
+        string sha = streamBlob(filepath, false, bytesRead);
+        if (objectExists(sha))
+        {
+            dedupedWrites++;
+            return sha;
+        }
+        if (config.getBool("chunking.enabled", false) &&
+            fs::file_size(filepath) >= uintmax_t(config.getInt("chunking.threshold", DEFAULT_CHUNK_THRESHOLD)))
+        {
+            writeChunkedBlob(filepath, sha);
+            return sha;
+        }
+        if (streamBlob(filepath, true) != sha)
+        {
+            throw runtime_error("File changed while hashing: " + filepath);
+        }
+        return sha;
+    }
+
+    // Write tree command; `dir` is the directory being written, relative to the root
+    string writeTree(const string &dir = "")
+    {
+        // cout << "coming to write tree\n";
+        stringstream treeContent;
+
+        // Order entries the way trees built from the index are ordered (directories sort as "name/")
+        vector<fs::directory_entry> dirEntries(fs::directory_iterator(workPath(dir)), fs::directory_iterator{});
+        auto sortKey = [](const fs::directory_entry &entry)
+        {
+            string key = entry.path().filename().string();
+            return entry.is_directory() ? key + "/" : key;
+        };
+        sort(dirEntries.begin(), dirEntries.end(), [&](const fs::directory_entry &a, const fs::directory_entry &b)
+             { return sortKey(a) < sortKey(b); });
+
+        // Iterate through the current directory
+        for (const auto &entry : dirEntries)
+        {
+            // cout << "entry is " << entry.path() << endl;
+
+            if (entry.path().filename().string() == GIT_DIR_NAME or entry.path().filename().string() == ".git")
+                continue; // Skip the .mygit directory
+
+            string name = entry.path().filename().string();
+            string path = dir.empty() ? name : dir + "/" + name;
+            string mode;
+            string sha;
+            string objectType;
+
+            if (fs::is_directory(entry))
+            {
+                // Directory: recurse into the subdirectory
+                mode = "040000";
+                sha = writeTree(path);
+                objectType = "tree";
+            }
+            else
+            {
+                // File: calculate its SHA-1 and store it as a blob
+                mode = "100644";
+                sha = hashObject(path, true);
+                objectType = "blob";
+            }
+
+            // Write entry as: mode objectType sha name
+            treeContent << mode << " " << objectType << " " << sha << " " << name << "\n";
+        }
+
+        // Return the SHA of the tree object
+        return writeObject(treeContent.str(), "tree");
+    }
+
+    // List the entries of a tree object
+    vector<TreeEntry> listTree(const string &sha)
+    {
+        vector<TreeEntry> entries;
+        for (auto &[mode, objectType, objectSha, name] : parseTree(sha))
+        {
+            entries.push_back({move(mode), move(objectType), move(objectSha), move(name)});
+        }
+        return entries;
+    }
+
+    // Result of staging a single file on a worker thread
+    struct StagedFile
+    {
+        string path;
+        string sha;
+        uintmax_t size = 0;
+        bool hashed = false; // false when the stat data proved the index entry still current
+        struct stat st = {};
+        exception_ptr error;
+    };
+
+    // Helper function to run the read -> hash -> compress -> write stages for every path
+    // pushed to `queue`, spread across `jobs` worker threads.
+    // Files whose stat data matches their index entry are not opened unless `refresh` is set.
+    vector<StagedFile> stageInParallel(WorkQueue<string> &queue, unsigned jobs, const IndexFile &index, bool refresh,
+                                       const function<void()> &produce)
+    {
+        vector<StagedFile> results;
+        mutex resultsLock;
+
+        vector<thread> workers;
+        for (unsigned i = 0; i < jobs; ++i)
+        {
+            workers.emplace_back([&]
+                                 {
+                string file;
+                while (queue.pop(file))
+                {
+                    StagedFile staged;
+                    staged.path = file;
+                    try
+                    {
+                        // Stat before reading so a concurrent edit shows up as a mismatch later
+                        if (stat(workPath(file).c_str(), &staged.st) != 0)
+                        {
+                            throw runtime_error("Cannot stat file: " + file);
+                        }
+                        IndexEntry cached;
+                        if (!refresh && index.find(file, cached) && index.isUpToDate(cached, staged.st))
+                        {
+                            staged.sha = cached.sha;
+                            tracer.count("add.stat-unchanged");
+                        }
+                        else
+                        {
+                            staged.sha = hashObject(file, true, &staged.size);
+                            staged.hashed = true;
+                        }
+                    }
+                    catch (...)
+                    {
+                        staged.error = current_exception();
+                    }
+                    lock_guard<mutex> guard(resultsLock);
+                    results.push_back(move(staged));
+                } });
+        }
+
+        try
+        {
+            produce();
+        }
+        catch (...)
+        {
+            queue.close();
+            for (thread &worker : workers)
+                worker.join();
+            throw;
+        }
+        queue.close();
+        for (thread &worker : workers)
+            worker.join();
+
+        // Workers finish in any order; sort so the index is written deterministically
+        sort(results.begin(), results.end(), [](const StagedFile &a, const StagedFile &b)
+             { return a.path < b.path; });
+        for (const StagedFile &staged : results)
+        {
+            if (staged.error)
+                rethrow_exception(staged.error);
+        }
+        return results;
+    }
+
+    // Helper function to record staged files in the index and summarize the work done.
+    // Entries under `pruneRoots` ("" for the whole tree) whose files no longer exist are dropped.
+    // `fsmonitorToken` is stored in the index for the next fsmonitor query.
+    AddResult recordStagedFiles(const IndexFile &index, const vector<StagedFile> &staged, const vector<string> &pruneRoots,
+                           unsigned jobs, chrono::steady_clock::time_point start, const string &fsmonitorToken)
+    {
+        map<string, CacheTreeEntry> cacheTree = parseCacheTree(index.extension("TREE"));
+        AddResult result;
+
+        // Carries an untouched index entry over, unless the file has been deleted or replaced by a directory
+        vector<IndexEntry> merged;
+        auto keepEntry = [&](size_t i)
+        {
+            if (!pruneRoots.empty() && isUnder(pruneRoots, index.pathAt(i)) && !fs::is_regular_file(workPath(index.pathAt(i))))
+            {
+                result.changes.push_back({string(index.pathAt(i)), "removed"});
+                invalidateCacheTree(cacheTree, index.pathAt(i));
+                return;
+            }
+            merged.push_back(index.entryAt(i));
+        };
+
+        // Both lists are sorted by path, so merge them in a single pass
+        merged.reserve(index.size() + staged.size());
+        size_t next = 0;
+        for (const StagedFile &file : staged)
+        {
+            if (file.hashed)
+            {
+                result.filesHashed++;
+                result.bytesHashed += file.size;
+            }
+            if (!merged.empty() && merged.back().path == file.path)
+                continue; // Same file listed twice on the command line
+
+            while (next < index.size() && index.pathAt(next) < file.path)
+            {
+                keepEntry(next++);
+            }
+
+            IndexEntry entry;
+            entry.path = file.path;
+            entry.sha = file.sha;
+            entry.setStat(file.st);
+            merged.push_back(entry);
+
+            // Check if file is already indexed and if the hash has changed
+            if (next < index.size() && index.pathAt(next) == file.path)
+            {
+                bool unchanged = index.entryAt(next++).sha == file.sha;
+                if (unchanged)
+                    continue; // Only the stat data is refreshed
+            }
+            invalidateCacheTree(cacheTree, file.path);
+            result.changes.push_back({file.path, "added"});
+        }
+        while (next < index.size())
+        {
+            keepEntry(next++);
+        }
+        syncObjects();
+        IndexFile::write(INDEX_PATH, merged, indexExtensions(cacheTree, fsmonitorToken));
+
+        result.filesSeen = staged.size();
+        result.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        result.threads = jobs;
+        result.objectsWritten = objectsWritten;
+        result.objectsDeduplicated = dedupedWrites;
+        return result;
+    }
+
+    // Function to add files to the index; `refresh` rehashes files even when their stat data is unchanged
+    AddResult addFiles(const vector<string> &files, unsigned jobs = 0, bool refresh = false)
+    {
+        jobs = resolveJobCount(jobs);
+        auto start = chrono::steady_clock::now();
+        shared_ptr<const IndexFile> indexFile = loadIndex();
+        const IndexFile &index = *indexFile;
+        WorkQueue<string> queue;
+        vector<StagedFile> staged = stageInParallel(queue, jobs, index, refresh, [&]
+                                                    {
+            for (const string &file : files)
+            {
+                // Skip adding directories
+                if (!fs::is_directory(workPath(file)))
+                    queue.push(file);
+            } });
+        return recordStagedFiles(index, staged, {}, jobs, start, index.extension("FSMN"));
+    }
+
+    // Function to add every regular file under the working directory, hashing while the walk continues.
+    // Unchanged files are detected from their stat data, so a no-op add is little more than the walk.
+    // With core.fsmonitor and a running daemon, only the paths changed since the last `add .` are walked.
+    AddResult addAll(unsigned jobs = 0, bool refresh = false)
+    {
+        jobs = resolveJobCount(jobs);
+        auto start = chrono::steady_clock::now();
+        shared_ptr<const IndexFile> indexFile = loadIndex();
+        const IndexFile &index = *indexFile;
+
+        // The token is taken before walking, so anything modified during the walk is reported next time
+        FsMonitor::Changes changes = queryFsMonitor(index);
+        vector<string> roots = changes.fullScan || refresh ? vector<string>{""} : outermostPaths(changes.paths);
+
+        WorkQueue<string> queue;
+        vector<StagedFile> staged = stageInParallel(queue, jobs, index, refresh, [&]
+                                                    {
+            TraceScope trace("walk");
+            for (const string &root : roots)
+            {
+                if (!root.empty() && !fs::is_directory(fs::symlink_status(workPath(root))))
+                {
+                    if (fs::is_regular_file(workPath(root)))
+                        queue.push(root);
+                    continue;
+                }
+                for (auto it = fs::recursive_directory_iterator(workPath(root));
+                     it != fs::recursive_directory_iterator(); ++it)
+                {
+                    string name = it->path().filename().string();
+                    // Skip the .mygit and .git directories entirely
+                    if (name == GIT_DIR_NAME || name == ".git")
+                    {
+                        it.disable_recursion_pending();
+                        continue;
+                    }
+
+                    // Queue regular files as soon as they are found
+                    if (it->is_regular_file())
+                    {
+                        queue.push(it->path().string().substr(WORK_TREE.size() + 1));
+                    }
+                }
+            } });
+        return recordStagedFiles(index, staged, roots, jobs, start, changes.token);
+    }
+
+    // Helper function to diff HEAD's tree against the index. A directory whose cached tree in the
+    // index matches HEAD's subtree over the same number of entries is skipped without being read.
+    void diffTreeAgainstIndex(const string &treeSha, const string &dir, const IndexFile &index,
+                              const map<string, CacheTreeEntry> &cacheTree, vector<char> &inHead,
+                              vector<PathChange> &staged)
+    {
+        string prefix = dir.empty() ? "" : dir + "/";
+        size_t begin = dir.empty() ? 0 : index.lowerBound(prefix);
+        size_t end = dir.empty() ? index.size() : index.lowerBound(dir + char('/' + 1));
+        auto cached = cacheTree.find(dir);
+        if (cached != cacheTree.end() && cached->second.sha == treeSha && cached->second.entryCount == end - begin)
+        {
+            fill(inHead.begin() + begin, inHead.begin() + end, 1);
+            return;
+        }
+
+        for (const auto &[mode, objectType, sha, name] : parseTree(treeSha))
+        {
+            string path = prefix + name;
+            if (objectType == "tree")
+            {
+                diffTreeAgainstIndex(sha, path, index, cacheTree, inHead, staged);
+                continue;
+            }
+            size_t pos = index.indexOf(path);
+            if (pos == IndexFile::npos)
+            {
+                staged.push_back({path, "deleted"});
+                continue;
+            }
+            inHead[pos] = 1;
+            IndexEntry entry = index.entryAt(pos);
+            if (entry.sha != sha || entry.mode != stoul(mode, nullptr, 8))
+            {
+                staged.push_back({path, "modified"});
+            }
+        }
+    }
+
+    // Helper function to compare the working tree with the index. Directories are read by `jobs`
+    // threads sharing a queue; a file is only hashed when its stat data no longer matches the index.
+    // With fsmonitor `changes`, only the reported paths are examined instead of the whole tree.
+    void diffWorkingTree(const IndexFile &index, unsigned jobs, vector<PathChange> &unstaged,
+                         vector<string> &untracked, const FsMonitor::Changes &changes)
+    {
+        vector<char> seen(index.size(), 0); // each position is written by at most one thread
+        vector<string> roots = changes.fullScan ? vector<string>{""} : outermostPaths(changes.paths);
+        WorkQueue<string> paths;
+        atomic<size_t> pending{roots.size()};
+        mutex resultsLock;
+        exception_ptr error;
+
+        // Compares one regular file with its index entry
+        auto examineFile = [&](const string &path, const struct stat &st, vector<PathChange> &changed,
+                               vector<string> &unknown)
+        {
+            size_t pos = index.indexOf(path);
+            if (pos == IndexFile::npos)
+            {
+                unknown.push_back(path);
+                return;
+            }
+            seen[pos] = 1;
+            IndexEntry entry = index.entryAt(pos);
+            if (index.isUpToDate(entry, st))
+                return;
+            tracer.count("status.files-hashed");
+            // A size change is conclusive once the entry carries stat data (legacy entries do not)
+            bool sizeChanged = entry.mtimeSec != 0 && uint64_t(st.st_size) != entry.size;
+            if (sizeChanged || hashObject(path) != entry.sha)
+            {
+                changed.push_back({path, "modified"});
+            }
+        };
+
+        // Examines a file, or every entry of a directory, queueing subdirectories for other threads
+        auto examine = [&](const string &path)
+        {
+            TraceScope trace("status.examine");
+            vector<PathChange> changed;
+            vector<string> unknown;
+            struct stat st;
+            if (!path.empty() && (lstat(workPath(path).c_str(), &st) != 0 || !S_ISDIR(st.st_mode)))
+            {
+                // Same rule as `add .`: regular files, following symlinks to them
+                if (stat(workPath(path).c_str(), &st) == 0 && S_ISREG(st.st_mode))
+                    examineFile(path, st, changed, unknown);
+            }
+            else
+            {
+                unique_ptr<DIR, int (*)(DIR *)> handle(opendir(workPath(path).c_str()), closedir);
+                if (!handle)
+                {
+                    throw runtime_error("Cannot open directory: " + workPath(path));
+                }
+                string prefix = path.empty() ? "" : path + "/";
+                while (dirent *item = readdir(handle.get()))
+                {
+                    string name = item->d_name;
+                    if (name == "." || name == ".." || name == GIT_DIR_NAME || name == ".git")
+                        continue;
+                    string child = prefix + name;
+                    string childPath = workPath(child);
+
+                    bool isDirectory = item->d_type == DT_DIR;
+                    if (item->d_type == DT_UNKNOWN && lstat(childPath.c_str(), &st) == 0)
+                        isDirectory = S_ISDIR(st.st_mode);
+                    if (isDirectory)
+                    {
+                        pending++;
+                        paths.push(child);
+                        continue;
+                    }
+                    if (stat(childPath.c_str(), &st) == 0 && S_ISREG(st.st_mode))
+                        examineFile(child, st, changed, unknown);
+                }
+            }
+
+            lock_guard<mutex> guard(resultsLock);
+            unstaged.insert(unstaged.end(), changed.begin(), changed.end());
+            untracked.insert(untracked.end(), unknown.begin(), unknown.end());
+        };
+
+        for (const string &root : roots)
+            paths.push(root);
+        if (roots.empty())
+            paths.close();
+        vector<thread> workers;
+        for (unsigned i = 0; i < jobs; ++i)
+        {
+            workers.emplace_back([&]
+                                 {
+                string path;
+                while (paths.pop(path))
+                {
+                    try
+                    {
+                        examine(path);
+                    }
+                    catch (...)
+                    {
+                        lock_guard<mutex> guard(resultsLock);
+                        if (!error)
+                            error = current_exception();
+                    }
+                    // The last path to finish closes the queue; subdirectories were counted before
+                    if (--pending == 0)
+                        paths.close();
+                } });
+        }
+        for (thread &worker : workers)
+            worker.join();
+        if (error)
+            rethrow_exception(error);
+
+        // Index entries that were not found are deleted, but only where the tree was examined
+        auto reportMissing = [&](size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; i++)
+            {
+                if (!seen[i])
+                    unstaged.push_back({index.pathAt(i), "deleted"});
+            }
+        };
+        for (const string &root : roots)
+        {
+            if (root.empty())
+            {
+                reportMissing(0, index.size());
+                continue;
+            }
+            size_t exact = index.indexOf(root);
+            if (exact != IndexFile::npos)
+                reportMissing(exact, exact + 1);
+            reportMissing(index.lowerBound(root + "/"), index.lowerBound(root + char('/' + 1)));
+        }
+    }
+
+    // Collect staged changes (HEAD vs index), unstaged changes (index vs working tree) and untracked files
+    StatusResult status(unsigned jobs = 0)
+    {
+        jobs = resolveJobCount(jobs);
+        shared_ptr<const IndexFile> indexFile = loadIndex();
+        const IndexFile &index = *indexFile;
+
+        vector<PathChange> staged;
+        vector<char> inHead(index.size(), 0);
+        string head = readHead();
+        if (!head.empty())
+        {
+            diffTreeAgainstIndex(parseCommit(head).tree, "", index, parseCacheTree(index.extension("TREE")), inHead,
+                                 staged);
+        }
+        for (size_t i = 0; i < index.size(); i++)
+        {
+            if (!inHead[i])
+                staged.push_back({index.pathAt(i), "new file"});
+        }
+
+        vector<PathChange> unstaged;
+        vector<string> untracked;
+        diffWorkingTree(index, jobs, unstaged, untracked, queryFsMonitor(index));
+
+        auto byPath = [](const PathChange &a, const PathChange &b)
+        { return a.path < b.path; };
+        sort(staged.begin(), staged.end(), byPath);
+        sort(unstaged.begin(), unstaged.end(), byPath);
+        sort(untracked.begin(), untracked.end());
+
+        return {head, move(staged), move(unstaged), move(untracked)};
+    }
+
+    // fsmonitor start|stop|status: manage the inotify daemon that `add .` and `status` query
+    // when core.fsmonitor is enabled
+    bool fsmonitorRunning()
+    {
+        string reply;
+        return FsMonitor(WORK_TREE, GIT_DIR_NAME).request("query", reply);
+    }
+
+    // Returns false when no daemon was running
+    bool stopFsMonitor()
+    {
+        FsMonitor monitor(WORK_TREE, GIT_DIR_NAME);
+        string reply;
+        return monitor.request("query", reply) && monitor.request("stop", reply);
+    }
+
+    bool fsmonitorEnabled() const { return config.getBool("core.fsmonitor", false); }
+
+    // Forks the daemon and waits until it answers; returns its pid, or 0 if one was already running
+    pid_t startFsMonitor()
+    {
+        FsMonitor monitor(WORK_TREE, GIT_DIR_NAME);
+        string reply;
+        if (monitor.request("query", reply))
+        {
+            return 0;
+        }
+        if (!fs::exists(GIT_DIR))
+        {
+            throw runtime_error("Not a mygit repository");
+        }
+
+        pid_t pid = fork();
+        if (pid < 0)
+        {
+            throw runtime_error("fork failed");
+        }
+        if (pid == 0)
+        {
+            // Detach from the terminal and run the watcher until asked to stop
+            setsid();
+            int devNull = open("/dev/null", O_RDWR);
+            dup2(devNull, STDIN_FILENO);
+            dup2(devNull, STDOUT_FILENO);
+            dup2(devNull, STDERR_FILENO);
+            try
+            {
+                monitor.serve();
+            }
+            catch (...)
+            {
+                _exit(1);
+            }
+            _exit(0);
+        }
+
+        // Wait until the initial watches are in place and the socket answers
+        for (int attempt = 0; attempt < 100; attempt++)
+        {
+            if (monitor.request("query", reply))
+            {
+                return pid;
+            }
+            this_thread::sleep_for(chrono::milliseconds(50));
+        }
+        throw runtime_error("fsmonitor did not start");
+    }
+
+    // end
+
+    // adding updated commit
+
+    // Updated commitChanges function to report the number of changed files
+    CommitResult commitChanges(const string &message = "")
+    {
+        // 1. Validate staging area
+        if (!fs::exists(INDEX_PATH))
+        {
+            throw runtime_error("Nothing to commit (create/copy files and use 'mygit add' to track)");
+        }
+
+        // 2. Retrieve parent commit's SHA from HEAD
+        string parentCommit = readHead(); // This might be empty for the first commit
+
+        // 3. The parent's tree, which the new tree is diffed against
+        string parentTree;
+        if (!parentCommit.empty())
+        {
+            parentTree = getTreeSHA(parentCommit);
+        }
+
+        // 4. Write the tree; cached subtrees keep this proportional to what was staged
+        function<void()> saveCacheTree;
+        string tree = createTreeFromIndex(saveCacheTree);
+
+        // 5. Diff against the parent tree, descending only into subtrees that changed
+        vector<DiffEntry> changes;
+        diffTrees(parentTree, tree, "", changes);
+        size_t changedFilesCount = changes.size();
+
+        // 6. No changes still produces a commit; the caller sees filesChanged == 0
+
+        // 7. Create and write the commit object with metadata
+        string commitMsg = message.empty() ? "Default commit message" : message;
+        stringstream commitContent;
+        commitContent << "tree " << tree << "\n";
+        if (!parentCommit.empty())
+            commitContent << "parent " << parentCommit << "\n";
+        commitContent << "author " << getAuthorInfo() << " " << getTimestamp() << "\n";
+        commitContent << "committer " << getAuthorInfo() << " " << getTimestamp() << "\n\n";
+        commitContent << commitMsg << "\n";
+        string commitSha = writeObject(commitContent.str(), "commit");
+
+        // 8. Make the new objects durable, then update the index's cached trees and HEAD; the index
+        // is kept so its stat data lets the next add skip unchanged files
+        syncObjects();
+        if (saveCacheTree)
+            saveCacheTree();
+        updateHead(commitSha);
+
+        // 9. Report the new commit with changed files count
+        return {commitSha, parentCommit, commitMsg, changedFilesCount};
+    }
+
+    // Helper function to create a tree object from index. When subtrees were written,
+    // `saveCacheTree` is set to record their SHAs in the index; the caller runs it after
+    // syncObjects(), so the index never refers to trees that are not on disk.
+    string createTreeFromIndex(function<void()> &saveCacheTree)
+    {
+        if (!fs::exists(INDEX_PATH))
+        {
+            throw runtime_error("Index file not found");
+        }
+
+        shared_ptr<const IndexFile> indexFile = loadIndex();
+        const IndexFile &index = *indexFile;
+        vector<IndexEntry> stagedFiles = index.entries();
+
+        if (stagedFiles.empty())
+        {
+            throw runtime_error("No files in staging area");
+        }
+
+        // Write tree from staged files directly, then persist any newly computed subtree SHAs
+        map<string, CacheTreeEntry> cacheTree = parseCacheTree(index.extension("TREE"));
+        size_t treesWritten = 0;
+        string treeSha = writeTreeFromStagedFiles(stagedFiles, cacheTree, treesWritten);
+        if (treesWritten > 0)
+        {
+            saveCacheTree = [this, stagedFiles, extensions = indexExtensions(cacheTree, index.extension("FSMN"))]
+            { IndexFile::write(INDEX_PATH, stagedFiles, extensions); };
+        }
+        return treeSha;
+    }
+    // Helper function to create nested tree objects from staged files; only directories
+    // whose contents changed since the cached trees were computed get rewritten
+    string writeTreeFromStagedFiles(const vector<IndexEntry> &stagedFiles, map<string, CacheTreeEntry> &cacheTree,
+                                    size_t &treesWritten)
+    {
+        // Index entries are already sorted by path, which keeps tree hashes consistent
+        return writeTreeRange(stagedFiles, 0, stagedFiles.size(), "", cacheTree, treesWritten);
+    }
+
+    // Consolidate all loose and packed objects into one pack, delta-encoding each object
+    // against similar objects (same type, same path where known) that precede it
+    RepackResult repack()
+    {
+        TraceScope trace("repack");
+        struct Candidate
+        {
+            string sha;
+            string type;
+            uint64_t size;
+            string pathHint;
+        };
+
+        // Chunked blobs (manifests and their chunks) stay loose: packing them as whole blobs would
+        // undo the sharing of unchanged chunks between versions
+        vector<string> looseObjects = listLooseObjects();
+        looseObjects.erase(remove_if(looseObjects.begin(), looseObjects.end(), [&](const string &sha)
+                                     {
+            string type;
+            uint64_t size;
+            return readLooseHeader(sha, type, size) && (type == "manifest" || type == "chunk"); }),
+                           looseObjects.end());
+        shared_ptr<const PackList> oldPackList = loadPacks();
+        set<string> allShas(looseObjects.begin(), looseObjects.end());
+        for (const auto &pack : *oldPackList)
+        {
+            for (uint32_t i = 0; i < pack->size(); i++)
+                allShas.insert(pack->shaAt(i));
+        }
+        RepackResult result;
+        if (allShas.empty())
+        {
+            return result;
+        }
+
+        map<string, string> hints;
+        collectPathHints(hints);
+
+        // First pass only records type and size, so contents are not all held at once
+        vector<Candidate> candidates;
+        candidates.reserve(allShas.size());
+        uint64_t looseBytes = 0;
+        for (const string &sha : allShas)
+        {
+            ObjectView object = viewObject(sha);
+            auto hint = hints.find(sha);
+            candidates.push_back({sha, object.type(), object.size(), hint == hints.end() ? "" : hint->second});
+        }
+        for (const string &sha : looseObjects)
+        {
+            looseBytes += fs::file_size(OBJECTS_DIR + "/" + sha.substr(0, 2) + "/" + sha.substr(2));
+        }
+
+        // Group by type and path, largest first, so later (usually smaller) versions delta against earlier ones
+        sort(candidates.begin(), candidates.end(), [](const Candidate &a, const Candidate &b)
+             {
+            if (a.type != b.type)
+                return a.type < b.type;
+            if (a.pathHint != b.pathHint)
+                return a.pathHint < b.pathHint;
+            if (a.size != b.size)
+                return a.size > b.size;
+            return a.sha < b.sha; });
+
+        string packDir = OBJECTS_DIR + "/pack";
+        createDirectory(packDir);
+        string tempPack;
+        int fd = createTempFile(packDir + "/tmp_pack_", tempPack);
+        if (fd < 0)
+        {
+            throw runtime_error("Cannot create temporary pack in " + packDir);
+        }
+
+        Sha1 checksum;
+        string buffer;
+        uint64_t written = 0;
+        auto flush = [&]()
+        {
+            checksum.update(buffer.data(), buffer.size());
+            writeAll(fd, buffer.data(), buffer.size());
+            written += buffer.size();
+            buffer.clear();
+        };
+
+        struct WindowEntry
+        {
+            string type;
+            ObjectView object;
+            uint64_t offset;
+            int depth;
+        };
+        deque<WindowEntry> window;
+        vector<pair<string, uint64_t>> indexEntries;
+        size_t deltaCount = 0;
+
+        try
+        {
+            buffer = "MGPK";
+            putBE32(buffer, 1);
+            putBE32(buffer, candidates.size());
+
+            for (const Candidate &candidate : candidates)
+            {
+                ObjectView object = viewObject(candidate.sha);
+                string_view content = object.content();
+                uint64_t offset = written + buffer.size();
+
+                // Pick the smallest delta from the window that saves at least half the object
+                const WindowEntry *bestBase = nullptr;
+                string bestDelta;
+                if (content.size() >= 32 && content.size() <= MAX_DELTA_SOURCE)
+                {
+                    for (const WindowEntry &base : window)
+                    {
+                        if (base.type != candidate.type || base.depth >= MAX_DELTA_DEPTH)
+                            continue;
+                        string delta = Delta::create(base.object.content(), content);
+                        if (delta.size() < content.size() / 2 && (!bestBase || delta.size() < bestDelta.size()))
+                        {
+                            bestBase = &base;
+                            bestDelta = move(delta);
+                        }
+                    }
+                }
+
+                int depth = 0;
+                string_view payload = bestBase ? string_view(bestDelta) : content;
+                int typeCode = bestBase ? PackFile::OBJ_OFS_DELTA : packTypeCode(candidate.type);
+                uint64_t size = payload.size();
+                unsigned char c = (typeCode << 4) | (size & 0x0f);
+                size >>= 4;
+                while (size)
+                {
+                    buffer.push_back(static_cast<char>(c | 0x80));
+                    c = size & 0x7f;
+                    size >>= 7;
+                }
+                buffer.push_back(static_cast<char>(c));
+
+                if (bestBase)
+                {
+                    // Distance back to the base, big-endian base-128 with an implicit +1 per continuation
+                    uint64_t distance = offset - bestBase->offset;
+                    unsigned char encoded[16];
+                    int pos = sizeof(encoded) - 1;
+                    encoded[pos] = distance & 0x7f;
+                    while (distance >>= 7)
+                        encoded[--pos] = 0x80 | (--distance & 0x7f);
+                    buffer.append(reinterpret_cast<const char *>(encoded + pos), sizeof(encoded) - pos);
+                    depth = bestBase->depth + 1;
+                    deltaCount++;
+                }
+                buffer += compressData(payload, candidate.type);
+                indexEntries.emplace_back(hexToRaw(candidate.sha), offset);
+
+                if (content.size() <= MAX_DELTA_SOURCE)
+                {
+                    window.push_back({candidate.type, move(object), offset, depth});
+                    if (window.size() > DELTA_WINDOW)
+                        window.pop_front();
+                }
+                if (buffer.size() >= STREAM_CHUNK_SIZE * 16)
+                    flush();
+            }
+            flush();
+
+            ObjectId digest = checksum.finish();
+            writeAll(fd, reinterpret_cast<const char *>(digest.data()), SHA_DIGEST_LENGTH);
+            written += SHA_DIGEST_LENGTH;
+            if (fsync(fd) != 0 || close(fd) != 0)
+            {
+                fd = -1;
+                throw runtime_error("Cannot flush pack to disk");
+            }
+            fd = -1;
+
+            // The pack goes into place before its index, so a visible index always has its pack
+            string name = "pack-" + digest.hex();
+            string packPath = packDir + "/" + name + ".pack";
+            string indexPath = packDir + "/" + name + ".idx";
+            string tempIndex = indexPath + ".tmp";
+            PackFile::writeIndex(tempIndex, indexEntries, string(reinterpret_cast<const char *>(digest.data()), SHA_DIGEST_LENGTH));
+            int indexFd = open(tempIndex.c_str(), O_RDONLY);
+            if (indexFd >= 0)
+            {
+                fsync(indexFd);
+                close(indexFd);
+            }
+            if (rename(tempPack.c_str(), packPath.c_str()) != 0 || rename(tempIndex.c_str(), indexPath.c_str()) != 0)
+            {
+                unlink(tempIndex.c_str());
+                throw runtime_error("Cannot move pack into place: " + packPath);
+            }
+            tempPack.clear();
+
+            // Everything now lives in the new pack; drop old packs and loose copies
+            vector<string> oldPacks;
+            for (const auto &pack : *oldPackList)
+            {
+                if (pack->packPath != packPath)
+                    oldPacks.push_back(pack->packPath);
+            }
+            {
+                lock_guard<mutex> guard(packsLock);
+                packs = make_shared<PackList>();
+                packsLoaded = false;
+            }
+            for (const string &oldPack : oldPacks)
+            {
+                fs::path oldIndex = oldPack;
+                oldIndex.replace_extension(".idx");
+                fs::remove(oldIndex);
+                fs::remove(oldPack);
+            }
+            for (const string &sha : looseObjects)
+            {
+                string objectDir = OBJECTS_DIR + "/" + sha.substr(0, 2);
+                fs::remove(objectDir + "/" + sha.substr(2));
+                if (fs::is_empty(objectDir))
+                    fs::remove(objectDir);
+            }
+
+            result.objects = candidates.size();
+            result.deltas = deltaCount;
+            result.packName = name;
+            result.packBytes = written;
+            result.looseObjectsRemoved = looseObjects.size();
+            result.looseBytesRemoved = looseBytes;
+            if (!readHead().empty())
+            {
+                result.commitGraphCommits = writeCommitGraph();
+            }
+            return result;
+        }
+        catch (...)
+        {
+            if (fd >= 0)
+                close(fd);
+            if (!tempPack.empty())
+                unlink(tempPack.c_str());
+            throw;
+        }
+    }
+
+    // What fsck learned about one stored object
+    struct FsckObject
+    {
+        string type;                       // as stored; empty when it could not be read
+        string error;                      // why it is corrupt; empty when it is fine
+        vector<pair<string, string>> refs; // (SHA, expected type) of the objects it points to
+        uint64_t bytes = 0;
+    };
+
+    // Helper function to verify one stored object: it must parse and hash to its name. A manifest
+    // is named after the blob it stands for, so its chunks are read and hashed in order; a chunk
+    // that cannot be read makes the manifest corrupt too, naming that chunk.
+    void checkObject(const string &sha, const ObjectCache::Entry &object, FsckObject &result)
+    {
+        result.type = object.type;
+        result.bytes = object.content.size();
+        auto addRef = [&](string_view ref, const char *type)
+        {
+            ObjectId id;
+            if (!ObjectId::parseHex(ref, id))
+                throw runtime_error("bad object name " + string(ref));
+            result.refs.emplace_back(string(ref), type);
+        };
+
+        Sha1 sha1;
+        if (object.type == "manifest")
+        {
+            vector<pair<string, uint64_t>> chunks = parseManifest(sha, object.content);
+            uint64_t total = 0;
+            for (const auto &[chunkSha, size] : chunks)
+            {
+                addRef(chunkSha, "chunk");
+                total += size;
+            }
+            string header = "blob " + to_string(total) + "$";
+            sha1.update(header.data(), header.size());
+            for (const auto &[chunkSha, size] : chunks)
+            {
+                shared_ptr<const ObjectCache::Entry> chunk;
+                try
+                {
+                    chunk = loadStoredObject(chunkSha);
+                }
+                catch (const exception &e)
+                {
+                    throw runtime_error("chunk " + chunkSha + " cannot be read: " + e.what());
+                }
+                if (chunk->type != "chunk" || chunk->content.size() != size)
+                    throw runtime_error("chunk " + chunkSha + " does not match the manifest");
+                sha1.update(chunk->content.data(), chunk->content.size());
+            }
+            result.bytes = total;
+        }
+        else
+        {
+            string header = object.type + " " + to_string(object.content.size()) + "$";
+            sha1.update(header.data(), header.size());
+            sha1.update(object.content.data(), object.content.size());
+
+            string_view rest = object.content, line;
+            if (object.type == "commit")
+            {
+                bool hasTree = false;
+                while (nextLine(rest, line) && !line.empty())
+                {
+                    if (line.rfind("tree ", 0) == 0)
+                    {
+                        addRef(line.substr(5), "tree");
+                        hasTree = true;
+                    }
+                    else if (line.rfind("parent ", 0) == 0)
+                        addRef(line.substr(7), "commit");
+                }
+                if (!hasTree)
+                    throw runtime_error("commit has no tree");
+            }
+            else if (object.type == "tree")
+            {
+                // Each entry is "mode objectType sha name"
+                while (nextLine(rest, line))
+                {
+                    size_t typeStart = line.find(' ');
+                    size_t shaStart = typeStart == string_view::npos ? typeStart : line.find(' ', typeStart + 1);
+                    size_t nameStart = shaStart == string_view::npos ? shaStart : line.find(' ', shaStart + 1);
+                    if (nameStart == string_view::npos || nameStart + 1 >= line.size())
+                        throw runtime_error("malformed tree entry");
+                    string_view entryType = line.substr(typeStart + 1, shaStart - typeStart - 1);
+                    if (entryType != "blob" && entryType != "tree")
+                        throw runtime_error("tree entry of unknown type " + string(entryType));
+                    addRef(line.substr(shaStart + 1, nameStart - shaStart - 1), entryType == "tree" ? "tree" : "blob");
+                }
             }
-        } while (ret == Z_OK);
-
-        deflateEnd(&zs);
-        return compressed;
+            else if (object.type != "blob" && object.type != "chunk")
+                throw runtime_error("unknown object type " + object.type);
+        }
+        if (sha1.finish().hex() != sha)
+            throw runtime_error("hash mismatch");
     }
 
-    // Helper function to decompress data
-    string decompressData(const string &data)
+    // Verify every stored object and the history's connectivity. Loose objects and pack entries
+    // are inflated and rehashed on `jobs` threads. The reachability walk from HEAD and the
+    // index then runs over the references collected on the way, so no object is read twice.
+    FsckResult fsck(unsigned jobs = 0)
     {
-        z_stream zs;
-        memset(&zs, 0, sizeof(zs));
+        TraceScope trace("fsck");
+        auto start = chrono::steady_clock::now();
+        FsckResult result;
+        result.threads = resolveJobCount(jobs);
 
-        if (inflateInit(&zs) != Z_OK)
+        // Every stored copy is checked, so an object both loose and packed is verified twice
+        struct Stored
         {
-            throw runtime_error("inflateInit failed");
+            string sha;
+            const PackFile *pack;
+            uint32_t index;
+        };
+        vector<Stored> stored;
+        for (string &sha : listLooseObjects())
+            stored.push_back({move(sha), nullptr, 0});
+        result.looseObjects = stored.size();
+        shared_ptr<const PackList> packList = loadPacks();
+        for (const auto &pack : *packList)
+        {
+            for (uint32_t i = 0; i < pack->size(); i++)
+                stored.push_back({pack->shaAt(i), pack.get(), i});
         }
+        result.packedObjects = stored.size() - result.looseObjects;
 
-        zs.next_in = (Bytef *)data.data();
-        zs.avail_in = data.size();
-
-        char outbuffer[32768];
-        string decompressed;
-
-        do
+        // A pack ends with the SHA-1 of everything before it
+        vector<char> packDamaged(packList->size(), 0);
+        runParallel(packList->size(), result.threads, [&](size_t i)
+                    {
+            const PackFile &pack = *(*packList)[i];
+            size_t body = pack.length() - SHA_DIGEST_LENGTH;
+            packDamaged[i] = memcmp(Sha1::hash(pack.data(), body).data(), pack.data() + body, SHA_DIGEST_LENGTH) != 0; });
+        for (size_t i = 0; i < packList->size(); i++)
         {
-            zs.next_out = reinterpret_cast<Bytef *>(outbuffer);
-            zs.avail_out = sizeof(outbuffer);
-
-            int ret = inflate(&zs, 0);
+            if (packDamaged[i])
+                result.corrupt.push_back({fs::path((*packList)[i]->packPath).filename().string(), "pack", "checksum mismatch"});
+        }
 
-            if (decompressed.size() < zs.total_out)
+        vector<FsckObject> checked(stored.size());
+        runParallel(stored.size(), result.threads, [&](size_t i)
+                    {
+            const Stored &item = stored[i];
+            try
             {
-                decompressed.append(outbuffer, zs.total_out - decompressed.size());
+                shared_ptr<const ObjectCache::Entry> object;
+                if (item.pack)
+                {
+                    auto [type, content] = readPackEntry(*item.pack, item.pack->offsetAt(item.index));
+                    object = make_shared<const ObjectCache::Entry>(ObjectCache::Entry{packTypeName(type), move(content)});
+                }
+                else
+                    object = loadStoredObject(item.sha);
+                checkObject(item.sha, *object, checked[i]);
             }
-
-            if (ret == Z_STREAM_END)
-                break;
-            if (ret != Z_OK)
+            catch (const exception &e)
             {
-                inflateEnd(&zs);
-                throw runtime_error("inflate failed");
+                checked[i].error = e.what();
             }
-        } while (true);
-
-        inflateEnd(&zs);
-
-        // cout<<"decopmressed data is "<<decompressed<<endl;
-        return decompressed;
-    }
-
-    // Helper function to write object to storage
-    string writeObject(const string &content, const string &type)
-    {
-        string header = type + " " + to_string(content.length()) + "$";
-        // header.push_back('$');
-        string store = header + content;
-        string sha = computeSHA1(store);
-
-        // cout<<" I am adding $\n";
+            tracer.count("fsck.objects"); });
 
-        string compressed = compressData(store);
-        string objectPath = OBJECTS_DIR + "/" + sha.substr(0, 2);
-        createDirectory(objectPath);
-        //  cout<<"compressed data is "<< compressed<<endl;
-        string filepath = objectPath + "/" + sha.substr(2);
-        ofstream file(filepath, ios::binary);
-        if (file.is_open())
+        unordered_map<ObjectId, size_t, ObjectIdHash> byId; // first stored copy of each object
+        unordered_set<ObjectId, ObjectIdHash> referenced;
+        byId.reserve(stored.size());
+        for (size_t i = 0; i < stored.size(); i++)
         {
-            file.write(compressed.c_str(), compressed.length());
-            file.close();
+            byId.emplace(ObjectId::fromHex(stored[i].sha), i);
+            result.bytes += checked[i].bytes;
+            for (const auto &ref : checked[i].refs)
+                referenced.insert(ObjectId::fromHex(ref.first));
+            if (!checked[i].error.empty())
+                result.corrupt.push_back({stored[i].sha, checked[i].type, checked[i].error});
         }
-        // cout<<"sha of file "<<filepath<<" is "<<sha<<endl;
-        return sha;
-    }
 
-    // Helper function to read object from storage
-    pair<string, string> readObject(const string &sha)
-    {
-        string objectPath = OBJECTS_DIR + "/" + sha.substr(0, 2) + "/" + sha.substr(2);
-        // cout<<"objectpath="<<objectPath<<endl;
-        ifstream file(objectPath, ios::binary);
-        //  cout<<"objectPath "<<objectPath<<endl;
-        if (!file.is_open())
+        // Walk from HEAD and the index; a chunked blob is a manifest where a blob is expected
+        vector<tuple<string, string, string>> pending; // (SHA, expected type, referrer)
+        string head = readHead();
+        if (!head.empty())
+            pending.emplace_back(head, "commit", "HEAD");
+        if (fs::exists(INDEX_PATH))
         {
-            throw runtime_error("Object not found: " + sha);
+            shared_ptr<const IndexFile> indexFile = loadIndex();
+            const IndexFile &index = *indexFile;
+            for (size_t i = 0; i < index.size(); i++)
+                pending.emplace_back(index.entryAt(i).sha, "blob", "the index");
         }
-
-        stringstream buffer;
-        buffer << file.rdbuf();
-        file.close();
-
-        string decompressed = decompressData(buffer.str());
-
-        size_t nullPos = decompressed.find('$');
-        if (nullPos == string::npos)
+        vector<char> reachable(stored.size(), 0);
+        set<string> missing;
+        while (!pending.empty())
         {
-            throw runtime_error("Invalid object format");
+            auto [sha, expected, referrer] = move(pending.back());
+            pending.pop_back();
+            auto found = byId.find(ObjectId::fromHex(sha));
+            if (found == byId.end())
+            {
+                if (missing.insert(sha).second)
+                    result.missing.push_back({sha, expected, "referenced by " + referrer});
+                continue;
+            }
+            size_t i = found->second;
+            if (reachable[i])
+                continue;
+            reachable[i] = 1;
+            const FsckObject &object = checked[i];
+            string type = object.type == "manifest" ? "blob" : object.type;
+            if (!object.type.empty() && type != expected)
+                result.corrupt.push_back({sha, object.type, "expected a " + expected + ", referenced by " + referrer});
+            string from = type + " " + sha;
+            for (const auto &[ref, refType] : object.refs)
+                pending.emplace_back(ref, refType, from);
         }
 
-        string header = decompressed.substr(0, nullPos);
-        string content = decompressed.substr(nullPos + 1);
+        // Like git, only report the tips of unreachable history, not everything they point to
+        for (const auto &[id, i] : byId)
+        {
+            if (!reachable[i] && !referenced.count(id) && checked[i].error.empty())
+                result.dangling.push_back({stored[i].sha, checked[i].type == "manifest" ? "blob" : checked[i].type, ""});
+        }
+        auto bySha = [](const FsckIssue &a, const FsckIssue &b)
+        { return a.sha < b.sha; };
+        sort(result.corrupt.begin(), result.corrupt.end(), bySha);
+        sort(result.missing.begin(), result.missing.end(), bySha);
+        sort(result.dangling.begin(), result.dangling.end(), bySha);
+        result.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        return result;
+    }
 
-        size_t spacePos = header.find(' ');
-        string type = header.substr(0, spacePos);
+    // HEAD and the index as last read, reused by later operations on the same MyGit while the
+    // files' stat data is unchanged
+    mutex stateLock;
+    shared_ptr<const IndexFile> cachedIndex;
+    struct stat cachedIndexStat = {};
+    string cachedHead;
+    struct stat cachedHeadStat = {};
+    bool headCached = false;
 
-        return {type, content};
+    static bool sameStat(const struct stat &a, const struct stat &b)
+    {
+        return a.st_dev == b.st_dev && a.st_ino == b.st_ino && a.st_size == b.st_size &&
+               a.st_mtim.tv_sec == b.st_mtim.tv_sec && a.st_mtim.tv_nsec == b.st_mtim.tv_nsec &&
+               a.st_ctim.tv_sec == b.st_ctim.tv_sec && a.st_ctim.tv_nsec == b.st_ctim.tv_nsec;
     }
 
-    // Helper function to join lines with a separator
-    string joinLines(const vector<string> &lines, size_t start, size_t end)
+    // Helper function to load the index, reusing the previous mapping while the file is unchanged.
+    // The index is only ever replaced by a rename, and the mapping keeps the old inode alive, so a
+    // rewritten index always shows up with a different inode.
+    shared_ptr<const IndexFile> loadIndex()
     {
-        string result;
-        for (size_t i = start; i < end; ++i)
+        struct stat st = {};
+        if (stat(INDEX_PATH.c_str(), &st) != 0)
+            st = {}; // a missing index is cached as empty too
+        lock_guard<mutex> guard(stateLock);
+        if (cachedIndex && sameStat(st, cachedIndexStat))
         {
-            result += lines[i];
-            if (i < end - 1)
-            {
-                result += "\n";
-            }
+            tracer.count("index.reused");
+            return cachedIndex;
         }
-        return result;
+        auto index = make_shared<IndexFile>();
+        index->load(INDEX_PATH);
+        cachedIndex = index;
+        cachedIndexStat = st;
+        return index;
     }
 
-    // Helper function to parse timestamp
-    time_t parseTimestamp(const string &timestampStr)
+    // Helper function to read HEAD commit. A cached HEAD is only trusted once the file is a few
+    // seconds older than its mtime granularity could hide: HEAD is small and rewritten in place of
+    // a freed inode, so a quick second write can keep the same stat data.
+    string readHead()
+    {
+        string headPath = GIT_DIR + "/HEAD";
+        struct stat st;
+        if (stat(headPath.c_str(), &st) != 0)
+            return "";
+        lock_guard<mutex> guard(stateLock);
+        if (headCached && sameStat(st, cachedHeadStat) && st.st_mtim.tv_sec + 2 < time(nullptr))
+            return cachedHead;
+
+        ifstream headFile(headPath);
+        string head;
+        if (!headFile.is_open())
+            return "";
+        getline(headFile, head);
+        cachedHead = head;
+        cachedHeadStat = st;
+        headCached = true;
+        return head;
+    }
+
+    // Helper function to update HEAD. Like the index, it is written to HEAD.lock and renamed into
+    // place, so a crash or a concurrent reader never sees a truncated HEAD.
+    void updateHead(const string &commitSha)
     {
+        {
+            lock_guard<mutex> guard(stateLock);
+            headCached = false;
+        }
+        string headPath = GIT_DIR + "/HEAD";
+        string lockPath = headPath + ".lock";
+        int fd = open(lockPath.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0644);
+        if (fd < 0)
+        {
+            throw runtime_error("Unable to create " + lockPath + ": another mygit process may be running");
+        }
         try
         {
-            return stol(timestampStr);
+            writeAll(fd, commitSha.data(), commitSha.size());
         }
-        catch (const invalid_argument &e)
+        catch (...)
         {
-            cerr << "Error: Invalid timestamp format in commit object." << endl;
-            return 0;
+            close(fd);
+            unlink(lockPath.c_str());
+            throw;
         }
-    }
-
-    // Helper function to retrieve the tree from a given commit SHA
-    map<string, string> getTreeFromCommit(const string &commitSha)
-    {
-        // cout<<"in get tree from commit\n";
-        map<string, string> fileToSha;
-        // ifstream commitFile(GIT_DIR + "/objects/" + commitSha.substr(0,2)+ "/" + commitSha.substr(2));
-        string line;
-        bool inTree = false;
-
-        // cout<<"path is "<<GIT_DIR + "/objects/" + commitSha.substr(0,2)+ "/" + commitSha.substr(2)<<endl;
-
-        string content = readObject(commitSha).second;
-        // cout<<"content is "<<content<<endl;
-
-        istringstream iss(content);
-        while (iss)
+        if (close(fd) != 0 || rename(lockPath.c_str(), headPath.c_str()) != 0)
         {
-            // iss>>;
-            // iss>>content;
-            string mode, sha, filename, type;
-            iss >> mode >> type >> sha >> filename;
-
-            // cout<<"mode"<<mode<<" sha"<<sha<<" fname"<<filename<<endl;
-            fileToSha[filename] = sha;
-            // cout<<filename<<" "<<sha<<" "<<"done"<<endl;
+            unlink(lockPath.c_str());
+            throw runtime_error("Could not update HEAD");
         }
-        // while (getline(commitFile, line)) {
-        //     if (line.find("tree") == 0) {
-        //         cout<<"find tree ";
-        //         inTree = true;
-        //         continue;
-        //     }
-        //     if (inTree && line.empty()) break;
+    }
 
-        //     if (inTree) {
-        //         istringstream iss(line);
-        //         string mode, sha, filename;
-        //         iss >> mode >> sha >> filename;
-        //         fileToSha[filename] = sha;
+    // Helper function to get current timestamp as string
 
-        //         cout<<filename<<" "<<sha<<" ";
-        //     }
-        // }
+    string getTimestamp()
+    {
+        time_t now = time(nullptr);
+        return to_string(now);
+    }
 
-        // cout<<endl;
-        return fileToSha;
+    // Helper function to get commit author info
+    string getAuthorInfo()
+    {
+        return "Saurav <sauravdeshmukh200@gmail.com>";
     }
 
-    // Function to retrieve SHA-1 hashes from the index
-    map<string, string> getIndexFileEntries()
+    // Helper function to count staged files
+    int countStagedFiles()
     {
-        map<string, string> indexEntries;
-        ifstream indexFile(GIT_DIR + "/index");
-        string line;
-        while (getline(indexFile, line))
-        {
-            istringstream iss(line);
-            string mode, sha, filename;
-            iss >> mode >> sha >> filename;
-            indexEntries[filename] = sha;
-        }
-        return indexEntries;
+        shared_ptr<const IndexFile> indexFile = loadIndex();
+        const IndexFile &index = *indexFile;
+        return index.size();
     }
 
-public:
-    // Initialize repository
-    bool init()
+    // Helper function to parse the header fields of a commit object
+    CommitGraph::Commit parseCommit(const string &sha)
     {
-        if (fs::exists(GIT_DIR))
+        ObjectView object = viewObject(sha);
+        if (object.type() != "commit")
         {
-            cerr << "Repository already exists" << endl;
-            return false;
+            throw runtime_error("Object is not a commit: " + sha);
         }
-
-        bool success = createDirectory(GIT_DIR) && createDirectory(OBJECTS_DIR);
-        if (success)
+        CommitGraph::Commit commit;
+        commit.sha = sha;
+        string_view rest = object.content(), line;
+        while (nextLine(rest, line) && !line.empty())
         {
-            cout << "Initialized empty MyGit repository in " << fs::absolute(GIT_DIR) << endl;
+            if (line.rfind("tree ", 0) == 0)
+                commit.tree = string(line.substr(5));
+            else if (line.rfind("parent ", 0) == 0)
+                commit.parents.emplace_back(line.substr(7));
+            else if (line.rfind("committer ", 0) == 0)
+                commit.timestamp = parseTimestamp(string(line.substr(line.find_last_of(' ') + 1)));
         }
-        return success;
+        return commit;
     }
 
-    // Hash object command
-    string hashObject(const string &filepath, bool write = false)
+    // Write objects/info/commit-graph covering every commit reachable from HEAD
+    size_t writeCommitGraph()
     {
-        ifstream file(filepath, ios::binary);
-        if (!file.is_open())
+        vector<CommitGraph::Commit> commits;
+        set<string> seen;
+        vector<string> pending;
+        string head = readHead();
+        if (!head.empty())
+            pending.push_back(head);
+        while (!pending.empty())
         {
-            throw runtime_error("Cannot open file: " + filepath);
+            string sha = pending.back();
+            pending.pop_back();
+            if (!seen.insert(sha).second)
+                continue;
+            commits.push_back(parseCommit(sha));
+            for (const string &parent : commits.back().parents)
+                pending.push_back(parent);
         }
 
-        stringstream buffer;
-        buffer << file.rdbuf();
-        file.close();
-
-        string content = buffer.str();
-        // cout<<"content is "<<content<<endl;
-        string sha = computeSHA1("blob " + to_string(content.length()) + "$" + content);
-
-        if (write)
-        {
-            // cout<<"writing blob oject having content "<<content<<endl;
-            writeObject(content, "blob");
-        }
-        // cout<<"sha of file "<<filepath<<" is "<<sha<<endl;
-        return sha;
+        createDirectory(OBJECTS_DIR + "/info");
+        CommitGraph::write(COMMIT_GRAPH_PATH, commits);
+        return commits.size();
     }
 
-    // Cat file command
-   void catFile(const string &sha, char flag)
+    // True when `ancestor` is reachable from `descendant` through parent links. With a commit-graph
+    // the walk is array indexing, and generation numbers prune every commit that is too old to
+    // lead to `ancestor`.
+    bool isAncestor(const string &ancestor, const string &descendant)
     {
-        try
+        CommitGraph graph;
+        uint32_t target, start;
+        if (graph.load(COMMIT_GRAPH_PATH) && graph.find(ancestor, target) && graph.find(descendant, start))
         {
-            auto [type, content] = readObject(sha);
-
-            switch (flag)
+            uint32_t targetGeneration = graph.generation(target);
+            vector<bool> visited(graph.size(), false);
+            vector<uint32_t> pending = {start};
+            while (!pending.empty())
             {
-            case 'p':
-                cout << content << "\n";
-                break;
-            case 't':
-                cout << type << endl;
-                break;
-            case 's':
-                cout << content.length() << endl;
-                break;
-            default:
-                throw runtime_error("Invalid flag");
+                uint32_t pos = pending.back();
+                pending.pop_back();
+                if (pos == target)
+                    return true;
+                if (visited[pos] || graph.generation(pos) <= targetGeneration)
+                    continue;
+                visited[pos] = true;
+                for (int which = 0; which < 2; which++)
+                {
+                    uint32_t parent = graph.parent(pos, which);
+                    if (parent != CommitGraph::NO_PARENT)
+                        pending.push_back(parent);
+                }
             }
+            return false;
         }
-        catch (const exception &e)
+
+        // No graph (or commits newer than it): walk the commit objects
+        set<string> seen;
+        vector<string> pending = {descendant};
+        while (!pending.empty())
         {
-            cerr << "Error: " << e.what() << endl;
+            string sha = pending.back();
+            pending.pop_back();
+            if (sha == ancestor)
+                return true;
+            if (!seen.insert(sha).second)
+                continue;
+            for (const string &parent : parseCommit(sha).parents)
+                pending.push_back(parent);
         }
-        
-
-
+        return false;
     }
 
-    // Write tree command
-    string writeTree()
+    // List history from HEAD, at most `maxCount` commits (0 = all). Once the walk reaches a commit
+    // the commit-graph covers, parents are followed by graph position and timestamps come from the
+    // graph; each listed commit is still read once for its committer and message text.
+    vector<LogEntry> logCommits(size_t maxCount = 0)
     {
-        // cout << "coming to write tree\n";
-        stringstream treeContent;
+        CommitGraph graph;
+        graph.load(COMMIT_GRAPH_PATH);
+        vector<LogEntry> history;
 
-        // Iterate through the current directory
-        for (const auto &entry : fs::directory_iterator("."))
+        if (!fs::exists(GIT_DIR + "/HEAD"))
         {
-            // cout << "entry is " << entry.path() << endl;
+            throw runtime_error("Failed to read HEAD file.");
+        }
+        string headCommit = readHead();
+        uint32_t pos = CommitGraph::NO_PARENT; // graph position of headCommit, once it is covered
+        if (!headCommit.empty())
+            graph.find(headCommit, pos);
 
-            if (entry.path().filename().string() == GIT_DIR or entry.path().filename().string() == ".git")
-                continue; // Skip the .mygit directory
+        while (!headCommit.empty() && (maxCount == 0 || history.size() < maxCount))
+        {
+            ObjectView object = viewObject(headCommit);
+            if (object.type() != "commit")
+            {
+                throw runtime_error("HEAD points to a non-commit object.");
+            }
 
-            string name = entry.path().filename().string();
-            string mode;
-            string sha;
-            string objectType;
+            string_view commitText = object.content(), line;
+            string parentCommit;
+            string committer, message;
+            time_t timestamp = 0;
 
-            if (fs::is_directory(entry))
+            bool inGraph = pos != CommitGraph::NO_PARENT;
+            uint32_t parentPos = CommitGraph::NO_PARENT;
+            if (inGraph)
             {
-                // Directory: change path to the subdirectory
-                mode = "040000";
-                string currentPath = fs::current_path().string(); // Store current path
-                fs::current_path(entry);                          // Change to the subdirectory
+                parentPos = graph.parent(pos, 0);
+                parentCommit = parentPos == CommitGraph::NO_PARENT ? "" : graph.sha(parentPos);
+                timestamp = graph.timestamp(pos);
+            }
+
+            // Parse the commit object
+            while (nextLine(commitText, line))
+            {
+                if (line.empty())
+                {
+                    // Commit message starts after the empty line
+                    if (nextLine(commitText, line))
+                        message = string(line);
+                    break;
+                }
+                else if (line.find("tree") == 0)
+                {
+                    // Ignore the tree line
+                }
+                else if (line.find("parent") == 0)
+                {
+                    // Extract the parent commit SHA
+                    if (!inGraph)
+                        parentCommit = string(line.substr(7));
+                }
+                else if (line.find("committ") == 0)
+                {
+                    // Extract the committer information
+                    committer = string(line.substr(10));
+                    string temp;
+                    int n=committer.size();
+                    for(int i=n-1;i>=0 and committer[i]!=' ';i--)
+                    {
+                        temp.push_back(committer[i]);
+                    }
 
-                sha = writeTree(); // Recursive call to handle the subdirectory
+                    reverse(temp.begin(),temp.end());
 
-                fs::current_path(currentPath); // Change back to the original path after recursion
-                objectType = "tree";
+                    if (!inGraph)
+                        timestamp=stoi(temp);
+                }
+            }
+
+            history.push_back({headCommit, parentCommit, message, committer, timestamp});
+
+            // Move to the parent commit; the graph is closed under parents, so once a commit is
+            // covered every later one is too and needs no lookup
+            headCommit = parentCommit;
+            pos = parentPos;
+            if (!inGraph && !headCommit.empty())
+                graph.find(headCommit, pos);
+        }
+        return history;
+    }
+
+    // Helper function to list every file under a tree (path -> blob SHA), optionally recording each
+    // directory's tree SHA and entry count in the same form as the index's cached trees
+    uint32_t flattenTree(const string &treeSha, const string &dir, map<string, pair<string, string>> &files,
+                         map<string, CacheTreeEntry> *cacheTree)
+    {
+        uint32_t count = 0;
+        string prefix = dir.empty() ? "" : dir + "/";
+        for (const auto &[mode, objectType, sha, name] : parseTree(treeSha))
+        {
+            if (objectType == "tree")
+            {
+                count += flattenTree(sha, prefix + name, files, cacheTree);
             }
             else
             {
-                // File: calculate its SHA-1 and store it as a blob
-                mode = "100644";
-                sha = hashObject(name, true);
-                objectType = "blob";
+                files[prefix + name] = {mode, sha};
+                count++;
             }
-
-            // Write entry as: mode objectType sha name
-            treeContent << mode << " " << objectType << " " << sha << " " << name << "\n";
         }
-
-        // Return the SHA of the tree object
-        return writeObject(treeContent.str(), "tree");
+        if (cacheTree)
+        {
+            (*cacheTree)[dir] = {count, treeSha};
+        }
+        return count;
     }
 
-    // Add this new method to the public section of the MyGit class
+    // Helper function to report every file under a tree as added ('A') or deleted ('D')
+    void diffWholeTree(const string &treeSha, const string &dir, char status, vector<DiffEntry> &changes)
+    {
+        string prefix = dir.empty() ? "" : dir + "/";
+        for (const auto &[mode, objectType, sha, name] : parseTree(treeSha))
+        {
+            if (objectType == "tree")
+                diffWholeTree(sha, prefix + name, status, changes);
+            else if (status == 'A')
+                changes.push_back({'A', prefix + name, "", "", mode, sha});
+            else
+                changes.push_back({'D', prefix + name, mode, sha, "", ""});
+        }
+    }
 
-    void listTree(const string &sha, bool nameOnly = false)
+    // Helper function to diff two trees by merge-walking their entries in name order. Entries with
+    // the same SHA and mode are skipped without being read, so identical subtrees cost nothing and
+    // the walk only descends along changed paths. An empty SHA stands for a missing tree.
+    void diffTrees(const string &oldTree, const string &newTree, const string &dir, vector<DiffEntry> &changes)
     {
-        try
+        if (oldTree == newTree)
+            return;
+        if (oldTree.empty() || newTree.empty())
+        {
+            diffWholeTree(oldTree.empty() ? newTree : oldTree, dir, oldTree.empty() ? 'A' : 'D', changes);
+            return;
+        }
+
+        // Trees are written in path order ("a.txt" before the directory "a"), so sort by name
+        auto byName = [](const tuple<string, string, string, string> &a, const tuple<string, string, string, string> &b)
+        { return get<3>(a) < get<3>(b); };
+        vector<tuple<string, string, string, string>> oldEntries = parseTree(oldTree);
+        vector<tuple<string, string, string, string>> newEntries = parseTree(newTree);
+        sort(oldEntries.begin(), oldEntries.end(), byName);
+        sort(newEntries.begin(), newEntries.end(), byName);
+
+        string prefix = dir.empty() ? "" : dir + "/";
+        // Reports one side of an entry; a subtree is expanded into its files
+        auto report = [&](const tuple<string, string, string, string> &entry, char status)
         {
-            auto [type, content] = readObject(sha); // Read the tree object using its SHA
+            const auto &[mode, objectType, sha, name] = entry;
+            if (objectType == "tree")
+                diffWholeTree(sha, prefix + name, status, changes);
+            else if (status == 'A')
+                changes.push_back({'A', prefix + name, "", "", mode, sha});
+            else
+                changes.push_back({'D', prefix + name, mode, sha, "", ""});
+        };
 
-            if (type != "tree")
+        size_t i = 0, j = 0;
+        while (i < oldEntries.size() || j < newEntries.size())
+        {
+            int order = i == oldEntries.size()   ? 1
+                        : j == newEntries.size() ? -1
+                                                 : get<3>(oldEntries[i]).compare(get<3>(newEntries[j]));
+            if (order < 0)
             {
-                throw runtime_error("Object is not a tree");
+                report(oldEntries[i++], 'D');
+                continue;
             }
-
-            istringstream stream(content);
-            string entry;
-
-            // Parse each entry in the tree content (mode, object type, sha, name)
-            while (getline(stream, entry))
+            if (order > 0)
             {
-                if (entry.empty())
-                    continue;
-
-                istringstream entryStream(entry);
-                string mode, objectType, objectSha, name;
-                entryStream >> mode >> objectType >> objectSha >> name;
+                report(newEntries[j++], 'A');
+                continue;
+            }
 
-                if (nameOnly)
-                {
-                    cout << name << endl; // Print only names if --name-only flag is used
-                }
-                else
-                {
-                    cout << mode << " " << objectType << " " << objectSha << " " << name << endl; // Print full details
-                }
+            const auto &[oldMode, oldType, oldSha, name] = oldEntries[i++];
+            const auto &[newMode, newType, newSha, newName] = newEntries[j++];
+            if (oldSha == newSha && oldMode == newMode)
+                continue;
+            if (oldType == "tree" && newType == "tree")
+                diffTrees(oldSha, newSha, prefix + name, changes);
+            else if (oldType != "tree" && newType != "tree")
+                changes.push_back({'M', prefix + name, oldMode, oldSha, newMode, newSha});
+            else
+            {
+                // A file replaced by a directory or the other way round
+                report(oldEntries[i - 1], 'D');
+                report(newEntries[j - 1], 'A');
             }
         }
-        catch (const exception &e)
-        {
-            cerr << "Error: " << e.what() << endl;
-        }
     }
 
-    // Function to add files to the index
-    void addFiles(const vector<string> &files)
+    // Helper function to accept either a commit or a tree where a tree is needed
+    string resolveTree(const string &sha)
+    {
+        ObjectView object = viewObject(sha);
+        if (object.type() == "tree")
+            return sha;
+        if (object.type() == "commit")
+            return getTreeSHA(sha);
+        throw runtime_error("Not a commit or tree: " + sha);
+    }
+
+    // Diff two commits (or trees): the files that differ, sorted by path
+    vector<DiffEntry> diff(const string &from, const string &to)
     {
-        set<string> addedFiles;         // To track filenames already added to the index
-        map<string, string> fileHashes; // To track filename and their last stored hashes
+        TraceScope trace("diff-tree");
+        vector<DiffEntry> changes;
+        diffTrees(resolveTree(from), resolveTree(to), "", changes);
+        sort(changes.begin(), changes.end(), [](const DiffEntry &a, const DiffEntry &b)
+             { return a.path < b.path; });
+        return changes;
+    }
 
-        // Open index file in read mode to load existing contents
-        ifstream indexRead(GIT_DIR + "/index");
-        string line;
-        while (getline(indexRead, line))
+    // Helper function to write one file's "diff --git" header and hunks. Blobs with a NUL byte in
+    // their first 8000 bytes are reported as binary, as git does. `newPath` defaults to change.path.
+    void writeFileDiff(const DiffEntry &change, unsigned context, const function<void(string_view)> &write,
+                       const string &newPath = "")
+    {
+        const string &oldPath = change.path, &path = newPath.empty() ? change.path : newPath;
+        string header = "diff --git a/" + oldPath + " b/" + path + "\n";
+        if (change.status == 'A')
+            header += "new file mode " + change.newMode + "\n";
+        else if (change.status == 'D')
+            header += "deleted file mode " + change.oldMode + "\n";
+        else if (change.oldMode != change.newMode)
+            header += "old mode " + change.oldMode + "\nnew mode " + change.newMode + "\n";
+        if (change.oldSha == change.newSha)
         {
-            istringstream iss(line);
-            string mode, sha, filename;
-            iss >> mode >> sha >> filename;
-            addedFiles.insert(filename);
-            fileHashes[filename] = sha; // Store the existing hash for comparison
+            write(header);
+            return;
         }
-        indexRead.close();
-
-        ofstream indexFile(GIT_DIR + "/index", ios::app); // Append mode for new entries
-        for (const string &file : files)
+        auto shortSha = [](const string &sha)
+        { return sha.empty() ? string(7, '0') : sha.substr(0, 7); };
+        header += "index " + shortSha(change.oldSha) + ".." + shortSha(change.newSha);
+        if (change.status == 'M' && change.oldMode == change.newMode && !change.oldMode.empty())
+            header += " " + change.oldMode;
+        header += "\n";
+
+        optional<ObjectView> oldBlob, newBlob;
+        string_view before, after;
+        if (!change.oldSha.empty())
+            before = oldBlob.emplace(viewObject(change.oldSha)).content();
+        if (!change.newSha.empty())
+            after = newBlob.emplace(viewObject(change.newSha)).content();
+        auto isBinary = [](string_view content)
+        { return content.substr(0, 8000).find('\0') != string_view::npos; };
+        string oldName = change.oldSha.empty() ? "/dev/null" : "a/" + oldPath;
+        string newName = change.newSha.empty() ? "/dev/null" : "b/" + path;
+        if (isBinary(before) || isBinary(after))
         {
-            // Skip adding directories
-            if (fs::is_directory(file))
-                continue;
-
-            // Generate the new SHA-1 hash
-            string newSha = hashObject(file, true);
+            write(header + "Binary files " + oldName + " and " + newName + " differ\n");
+            return;
+        }
 
-            // Check if file is already indexed and if the hash has changed
-            if (addedFiles.find(file) != addedFiles.end() && fileHashes[file] == newSha)
-            {
-                continue; // Skip if the file's hash is the same as before
-            }
+        vector<string_view> oldLines = LineDiff::split(before), newLines = LineDiff::split(after);
+        LineDiff lineDiff(oldLines, newLines);
+        write(header + "--- " + oldName + "\n+++ " + newName + "\n");
+        lineDiff.writeUnified(write, context);
+    }
 
-            // Write the file's details (mode, SHA, filename) to the index
-            string mode = "100644"; // Regular file mode
-            indexFile << mode << " " << newSha << " " << file << endl;
-            addedFiles.insert(file); // Add to the set to prevent duplicates
-            cout << "Added " << file << " to the index." << endl;
+    // Unified diff between two commits or trees (every changed file), or between two blobs
+    void unifiedDiff(const string &from, const string &to, unsigned context, const function<void(string_view)> &write)
+    {
+        TraceScope trace("diff");
+        if (viewObject(from).type() == "blob" && viewObject(to).type() == "blob")
+        {
+            writeFileDiff({'M', from, "", from, "", to}, context, write, to);
+            return;
         }
-        indexFile.close();
+        for (const DiffEntry &change : diff(from, to))
+            writeFileDiff(change, context, write);
     }
 
-    // end
-
-    // adding updated commit
-
-    // Updated commitChanges function to display the number of changed files
-    void commitChanges(const string &message = "")
+    // Working-tree changes needed to move from the current HEAD tree to a target tree
+    struct CheckoutPlan
     {
-        try
+        vector<pair<string, string>> writes; // path -> blob SHA
+        vector<string> deletes;
+        set<string> directories;   // parents of every written file; sorted order puts parents first
+        vector<IndexEntry> entries; // the index after checkout
+        vector<char> keepStat;      // per entry: it carries a local change, so its stat data is not refreshed
+        vector<string> conflicts;   // paths whose local changes the checkout would overwrite
+        vector<string> staged;      // carried-over staged changes, which invalidate the target's cached trees
+        size_t unchanged = 0;
+    };
+
+    // Helper function to turn the HEAD-to-target tree diff into working-tree changes. Every path is
+    // compared with HEAD through its index entry and working file (hashed only when the stat data is
+    // stale). Local changes to paths the diff does not mention are carried over; local changes to
+    // paths it does mention are reported as conflicts unless `force` discards them.
+    CheckoutPlan planCheckout(const vector<DiffEntry> &changes, const map<string, pair<string, string>> &target,
+                              const IndexFile &index, bool force)
+    {
+        CheckoutPlan plan;
+        map<string, string> headShas; // paths the diff mentions -> blob SHA in HEAD, empty when added
+        for (const DiffEntry &change : changes)
+            headShas[change.path] = change.oldSha;
+
+        auto planPath = [&](const string &path, const string &headSha, const pair<string, string> *targetEntry)
         {
-            // 1. Validate staging area
-            string indexPath = GIT_DIR + "/index";
-            if (!fs::exists(indexPath))
+            string targetSha = targetEntry ? targetEntry->second : "";
+            IndexEntry indexed;
+            bool staged = index.find(path, indexed);
+            string indexSha = staged ? indexed.sha : "";
+            string workingSha;
+            struct stat st;
+            if (stat(workPath(path).c_str(), &st) == 0 && S_ISREG(st.st_mode))
             {
-                throw runtime_error("Nothing to commit (create/copy files and use 'mygit add' to track)");
+                if (staged && index.isUpToDate(indexed, st))
+                {
+                    workingSha = indexed.sha;
+                }
+                else
+                {
+                    tracer.count("checkout.files-hashed");
+                    workingSha = hashObject(path);
+                }
             }
 
-            // 2. Retrieve parent commit's SHA from HEAD
-            string parentCommit = readHead(); // This might be empty for the first commit
-            // cout << "DEBUG: parentCommit: '" << parentCommit << "'" << endl;  // Debugging
-
-            map<string, string> parentTree;
-
-            // 3. Check if there is a parent commit
-            if (!parentCommit.empty())
+            if (!force && headSha == targetSha &&
+                (indexSha != targetSha || (!workingSha.empty() && workingSha != targetSha)))
             {
-                // Get the path to the parent commit file
-                string parentCommitPath = GIT_DIR + "/objects/" + parentCommit.substr(0, 2) + "/" + parentCommit.substr(2);
-                // cout << "DEBUG: parentCommitPath: '" << parentCommitPath << "'" << endl;  // Debugging
-
-                //    commitFile=<<endl;
-                string treeSha = readObject(parentCommit).second.substr(5, 40);
-
-                // cout<<"tree sha is"<<treeSha<<endl;
-
-                // ifstream commitFile(readObject(parentCommit).second);
-                // if (!commitFile.is_open()) {
-                //     throw runtime_error("Unable to open parent commit file.");
-                // }
-                // cout<<"commfile is"<<commitFile.string()<<endl;
-
-                // cout<<"line "<<endl;
-                // while (getline(commitFile, line)) {
-                //      cout<<"labove ine is "<<line<<endl;
-                //     if (line.find("tree") == 0) {
-                //         istringstream iss(line);
-                //         string temp;
-                //         iss >> temp >> treeSha; // extract the tree SHA
-                //         // cout<<"line is "<<line<<endl;
-                //         // treeSha=line.substr(5,40);
-                //         break;
-                //     }
-                // }
-                // commitFile.close();
-
-                // cout << "DEBUG: treeSha: '" << treeSha << "'" << endl;  // Debugging
-
-                // Check if treeSha is empty before using substr()
-                if (treeSha.empty())
+                if (staged)
                 {
-                    throw runtime_error("Tree SHA is empty, possible corruption in the commit object.");
+                    plan.entries.push_back(indexed);
+                    plan.keepStat.push_back(1);
                 }
-
-                // Access the tree object using its SHA-1
-                string treePath = GIT_DIR + "/objects/" + treeSha.substr(0, 2) + "/" + treeSha.substr(2);
-                // cout << "DEBUG: treePath: '" << treePath << "'" << endl;  // Debugging
-                parentTree = getTreeFromCommit(treeSha); // Retrieve the tree contents as a map
+                if (indexSha != targetSha)
+                    plan.staged.push_back(path);
+                return;
             }
-            else
+            if (!force && ((indexSha != headSha && indexSha != targetSha) ||
+                           (!workingSha.empty() && workingSha != headSha && workingSha != targetSha)))
             {
-                // No parent commit, this is the first commit
-                cout << "This is the first commit." << endl;
+                plan.conflicts.push_back(path);
+                return;
             }
 
-            // 4. Retrieve current index entries
-            map<string, string> currentIndex = getIndexFileEntries();
-            int changedFilesCount = 0;
-            //  cout<<"currrnt ="<<
-            // 5. Compare index with the parent tree
-            for (const auto &[filename, sha] : currentIndex)
+            if (!targetEntry)
             {
-                // If the file is new (not in the parent tree) or modified (SHA differs)
-                if (parentTree.find(filename) == parentTree.end() || parentTree[filename] != sha)
-                {
-                    changedFilesCount++;
-                }
+                if (!workingSha.empty())
+                    plan.deletes.push_back(path);
+                return;
             }
-
-            // 6. If no changes are detected, print a message and return
-            if (changedFilesCount == 0)
+            if (!staged || indexSha != targetSha)
             {
-                cout << "0 changes to commit" << endl;
-                // return;
+                indexed = IndexEntry();
+                indexed.path = path;
+                indexed.sha = targetSha;
+                indexed.mode = stoul(targetEntry->first, nullptr, 8);
             }
+            plan.entries.push_back(indexed);
+            plan.keepStat.push_back(0);
+            if (workingSha == targetSha)
+            {
+                plan.unchanged++;
+                return;
+            }
+            plan.writes.emplace_back(path, targetSha);
+            for (size_t slash = path.find('/'); slash != string::npos; slash = path.find('/', slash + 1))
+            {
+                plan.directories.insert(path.substr(0, slash));
+            }
+        };
 
-            // 7. Create and write the commit object with metadata
-            string commitMsg = message.empty() ? "Default commit message" : message;
-            stringstream commitContent;
-            commitContent << "tree " << createTreeFromIndex() << "\n";
-            if (!parentCommit.empty())
-                commitContent << "parent " << parentCommit << "\n";
-            commitContent << "author " << getAuthorInfo() << " " << getTimestamp() << "\n";
-            commitContent << "committer " << getAuthorInfo() << " " << getTimestamp() << "\n\n";
-            commitContent << commitMsg << "\n";
-            string commitSha = writeObject(commitContent.str(), "commit");
-
-            // 8. Update HEAD and clear index
-            updateHead(commitSha);
-            ofstream indexFile(indexPath, ios::trunc); // Clear index after commit
-            indexFile.close();
-
-            // 9. Output success message with changed files count
-            cout << "[main " << commitSha.substr(0, 7) << "] " << commitMsg << "\n";
-            cout << "Files changed: " << changedFilesCount << endl;
-        }
-        catch (const exception &e)
+        for (const auto &[path, entry] : target)
         {
-            cerr << "Error: " << e.what() << endl;
+            auto changed = headShas.find(path);
+            planPath(path, changed == headShas.end() ? entry.second : changed->second, &entry);
         }
-    }
-
-    // Helper function to create a tree object from index
-    string createTreeFromIndex()
-    {
-        vector<string> stagedFiles;
-        string indexPath = GIT_DIR + "/index";
-        ifstream indexFile(indexPath);
-
-        if (!indexFile.is_open())
+        for (const DiffEntry &change : changes)
         {
-            throw runtime_error("Index file not found");
+            if (change.status == 'D')
+                planPath(change.path, change.oldSha, nullptr);
         }
-
-        string line;
-        while (getline(indexFile, line))
+        // Staged new files are in neither tree; they stay staged unless the checkout is forced
+        for (size_t i = 0; i < index.size() && !force; i++)
         {
-            if (!line.empty())
+            string path = index.pathAt(i);
+            if (!target.count(path) && !headShas.count(path))
             {
-                stagedFiles.push_back(line);
+                plan.entries.push_back(index.entryAt(i));
+                plan.keepStat.push_back(1);
+                plan.staged.push_back(path);
             }
         }
-        indexFile.close();
+        return plan;
+    }
 
-        if (stagedFiles.empty())
+    // Helper function to write one blob to `path`; its directory must already exist.
+    // Returns the number of bytes written.
+    size_t checkoutBlob(const string &path, const string &sha)
+    {
+        // Chunked blobs are written chunk by chunk instead of being reassembled in memory
+        vector<pair<string, uint64_t>> chunks;
+        if (readManifest(sha, chunks))
         {
-            throw runtime_error("No files in staging area");
+            TraceScope trace("checkout.write-chunked-file");
+            ofstream restoredFile(workPath(path), ios::binary | ios::trunc);
+            size_t written = readChunks(sha, chunks, [&](string_view chunk)
+                                        { restoredFile.write(chunk.data(), chunk.size()); });
+            if (!restoredFile)
+            {
+                throw runtime_error("Cannot write " + path);
+            }
+            trace.addBytes(written);
+            return written;
         }
 
-        // Write tree from staged files directly
-        return writeTreeFromStagedFiles(stagedFiles);
-    }
-    //  static int countin=0;
-    // Helper function to create tree object from staged files
-    string writeTreeFromStagedFiles(const vector<string> &stagedFiles)
-    {
-        stringstream treeContent;
-
-        // Sort files to ensure consistent tree hashes
-        map<string, pair<string, string>> sortedEntries; // filename -> (mode, sha)
-        int count = 0;
-        for (const string &line : stagedFiles)
+        ObjectView object = viewObject(sha);
+        if (object.type() != "blob")
         {
-            istringstream iss(line);
-            string mode, sha, filename;
-            iss >> mode >> sha >> filename;
-            sortedEntries[filename] = make_pair(mode, sha);
-            count++;
+            throw runtime_error("Object is not of type 'blob' for SHA " + sha);
         }
-
-        cout << count << " files wass there in staging area" << endl;
-
-        // Build tree content from sorted entries
-        for (const auto &entry : sortedEntries)
+        string_view content = object.content();
+        TraceScope trace("checkout.write-file", content.size());
+        ofstream restoredFile(workPath(path), ios::binary | ios::trunc);
+        restoredFile.write(content.data(), content.size());
+        if (!restoredFile)
         {
-            treeContent << entry.second.first << " blob " << entry.second.second
-                        << " " << entry.first << "\n";
+            throw runtime_error("Cannot write " + path);
         }
-
-        // Write and return tree object
-        return writeObject(treeContent.str(), "tree");
+        return content.size();
     }
 
-    // Helper function to read HEAD commit
-    string readHead()
+    // Helper function to remove a tracked file and any directories it leaves empty
+    void removeCheckedOutFile(const string &path)
     {
-        string headPath = GIT_DIR + "/HEAD";
-        ifstream headFile(headPath);
-        string head;
-
-        if (headFile.is_open())
+        fs::remove(workPath(path));
+        fs::path dir = fs::path(path).parent_path();
+        while (!dir.empty() && fs::is_directory(workPath(dir.string())) && fs::is_empty(workPath(dir.string())))
         {
-            getline(headFile, head);
-            headFile.close();
-            return head;
+            fs::remove(workPath(dir.string()));
+            dir = dir.parent_path();
         }
-        return "";
     }
 
-    // Helper function to update HEAD
-    void updateHead(const string &commitSha)
+    // Check out a commit by applying only the difference between the HEAD tree and the target tree,
+    // then point HEAD and the index at the target. Directories are created up front in parent-first
+    // order, then blobs are inflated and written by `jobs` threads.
+    CheckoutResult checkout(const string &commitSHA, unsigned jobs = 0, bool force = false)
     {
-        string headPath = GIT_DIR + "/HEAD";
-        ofstream headFile(headPath);
-        if (headFile.is_open())
+        jobs = resolveJobCount(jobs);
+        auto start = chrono::steady_clock::now();
+        string treeSHA = getTreeSHA(commitSHA);
+        if (treeSHA.empty())
         {
-            headFile << commitSha;
-            headFile.close();
+            throw runtime_error("Invalid commit SHA: " + commitSHA);
         }
-        else
+
+        map<string, pair<string, string>> target;
+        map<string, CacheTreeEntry> cacheTree;
+        flattenTree(treeSHA, "", target, &cacheTree);
+        string head = readHead();
+        vector<DiffEntry> changes;
+        diffTrees(head.empty() ? "" : getTreeSHA(head), treeSHA, "", changes);
+
+        shared_ptr<const IndexFile> indexFile = loadIndex();
+        const IndexFile &index = *indexFile;
+        CheckoutPlan plan = planCheckout(changes, target, index, force);
+        if (!plan.conflicts.empty())
         {
-            throw runtime_error("Could not update HEAD");
+            string message = "Local changes to the following files would be overwritten by checkout:\n";
+            for (const string &path : plan.conflicts)
+                message += "  " + path + "\n";
+            throw runtime_error(message + "Commit them, or use checkout -f to discard them");
         }
-    }
-
-    // Helper function to get current timestamp as string
-
-    string getTimestamp()
-    {
-        time_t now = time(nullptr);
-        return to_string(now);
-    }
-
-    // Helper function to get commit author info
-    string getAuthorInfo()
-    {
-        return "Saurav <sauravdeshmukh200@gmail.com>";
-    }
-
-    // Helper function to count staged files
-    int countStagedFiles()
-    {
-        int count = 0;
-        ifstream indexFile(GIT_DIR + "/index");
-        string line;
-        while (getline(indexFile, line))
+        // A new directory may only replace a tracked file that the checkout deletes
+        set<string> deleted(plan.deletes.begin(), plan.deletes.end());
+        for (const string &dir : plan.directories)
         {
-            if (!line.empty())
+            struct stat st;
+            if (stat(workPath(dir).c_str(), &st) == 0 && !S_ISDIR(st.st_mode) && !deleted.count(dir))
             {
-                count++;
+                throw runtime_error("Cannot create directory " + dir + ": a file that checkout does not delete is in the way");
             }
         }
-        return count;
-    }
-
-    void logCommits()
-    {
 
-        // cout<<"printing path "<<OBJECTS_DIR<<endl;
-        string headCommit;
-        ifstream headFile(GIT_DIR + "/HEAD");
-        if (headFile.is_open())
-        {
-            getline(headFile, headCommit);
-            headFile.close();
-        }
-        else
+        for (const string &path : plan.deletes)
         {
-            cerr << "Error: Failed to read HEAD file." << endl;
-            return;
+            removeCheckedOutFile(path);
         }
-
-        while (!headCommit.empty())
+        for (const string &dir : plan.directories)
         {
-            auto [type, content] = readObject(headCommit);
-            if (type != "commit")
-            {
-                cerr << "Error: HEAD points to a non-commit object." << endl;
-                return;
-            }
-
-            istringstream commitStream(content);
-            string line;
-            string parentCommit;
-            string author, committer, message;
-            time_t timestamp = 0;
-
-            // Parse the commit object
-            while (getline(commitStream, line))
-            {
-                if (line.empty())
-                {
-                    // Commit message starts after the empty line
-                    getline(commitStream, message);
-                    break;
-                }
-                else if (line.find("tree") == 0)
-                {
-                    // Ignore the tree line
-                }
-                else if (line.find("parent") == 0)
-                {
-                    // Extract the parent commit SHA
-                    parentCommit = line.substr(7);
-                }
-                // else if (line.find("author") == 0)
-                // {
-                //     // Extract the author information
-                //     author = line.substr(7); // Skip "author " (7 characters)
-
-                //     // Find the position of the last space, which is before the timestamp
-                //     size_t lastSpacePos = author.find_last_of(' ');
-                //     if (lastSpacePos != string::npos)
-                //     {
-                //         string timestampStr = author.substr(lastSpacePos + 1); // Get the timestamp part
-                //         author = author.substr(0, lastSpacePos);               // Get the author email part
-
-                //         // Convert timestamp to integer
-                //         try
-                //         {
-                //             timestamp = stol(timestampStr);
-                //         }
-                //         catch (const invalid_argument &e)
-                //         {
-                //             cerr << "Error: Invalid timestamp format in commit object." << endl;
-                //         }
-                //     }
-                // }
-                else if (line.find("committ") == 0)
-                {
-                    // Extract the committer information
-                    committer = line.substr(10);
-                    string temp;
-                    int n=committer.size();
-                    for(int i=n-1;i>=0 and committer[i]!=' ';i--)
-                    {
-                        temp.push_back(committer[i]);
-                    }
-
-                    reverse(temp.begin(),temp.end());
-
-                    timestamp=stoi(temp);
-                }
-            }
-
-            // Print the commit information
-            cout << "commit " << headCommit << endl;
-            if (!parentCommit.empty())
+            if (!fs::is_directory(workPath(dir)))
             {
-                cout << "parent " << parentCommit << endl;
+                fs::create_directory(workPath(dir));
             }
-            // cout << "Author: " << author << endl;
-            cout<<"commit message :"<< message << endl;
+        }
+        atomic<uint64_t> bytesWritten{0};
+        runParallel(plan.writes.size(), jobs, [&](size_t i)
+                    { bytesWritten += checkoutBlob(plan.writes[i].first, plan.writes[i].second); });
 
-            // Format and print the timestamp
-            if (timestamp != 0)
-            {
-                tm *gmt = gmtime(&timestamp); // Get UTC time
-                stringstream ss;
-                ss << put_time(gmt, "%Y-%m-%d %H:%M:%S UTC");
-                cout<<"date and time :"<<ss.str()<<endl;
-            }
-            else
+        // The index now describes the target tree plus any carried-over local changes; files that were
+        // written or found unchanged get fresh stat data
+        for (size_t i = 0; i < plan.entries.size(); i++)
+        {
+            struct stat st;
+            if (!plan.keepStat[i] && stat(workPath(plan.entries[i].path).c_str(), &st) == 0)
             {
-                cout << " (invalid timestamp)" << endl;
+                plan.entries[i].setStat(st);
             }
-
-            cout<<"commiter info: "<<committer<<endl<<endl;
-
-            // Move to the parent commit
-            headCommit = parentCommit;
         }
+        for (const string &path : plan.staged)
+        {
+            invalidateCacheTree(cacheTree, path);
+        }
+        IndexFile::write(INDEX_PATH, plan.entries, indexExtensions(cacheTree, index.extension("FSMN")));
+        updateHead(commitSHA);
+
+        CheckoutResult result;
+        result.commit = commitSHA;
+        result.written = plan.writes.size();
+        result.deleted = plan.deletes.size();
+        result.unchanged = plan.unchanged;
+        result.bytesWritten = bytesWritten;
+        result.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        result.threads = jobs;
+        return result;
     }
 
-    void checkout(const string& commitSHA) {
-    string treeSHA = getTreeSHA(commitSHA);
-    // if (treeSHA.empty()) {
-    //     cerr << "Error: Invalid commit SHA." << endl;
-    //     return;
-    // }
-
-    vector<tuple<string, string, string, string>> treeEntries = parseTree(treeSHA);
-    restoreFiles(treeEntries);
-
-    cout << "Checked out commit " << commitSHA << endl;
-}
-
 
 // void restoreFiles(const vector<pair<string, string>>& treeEntries) {
 //     for (const auto& entry : treeEntries) {
@@ -893,121 +6416,250 @@ public:
 // }
 
 
-void restoreFiles(const vector<tuple<string, string, string, string>>& treeEntries) {
-    for (const auto& entry : treeEntries) {
-        string mode, objectType, sha, name;
-        tie(mode, objectType, sha, name) = entry;
-
-        if (objectType == "blob") { // File
-            pair<string, string> blobData = readObject(sha);
-
-            if (blobData.first != "blob") {
-                cerr << "Error: Object is not of type 'blob' for SHA " << sha << endl;
-                continue;
-            }
-
-            // // Skip the header in the blob
-            // size_t headerEnd = blobData.second.find('$');
-            // if (headerEnd == string::npos) {
-            //     cerr << "Error: Invalid blob object format for SHA " << sha << endl;
-            //     continue;
-            // }
-            string blobContent = blobData.second;
-            // Ensure parent directories exist
-            createDirectories(name);
-
-            // Write blob content to file
-            ofstream restoredFile(name, ios::binary);
-            restoredFile << blobContent;
-            restoredFile.close();
-
-        } else if (objectType == "tree") { // Directory
-            mkdir(name.c_str(), 0755); // Create directory
-            restoreFiles(parseTree(sha)); // Recursively restore subdirectories
-        }
-    }
-}
-
-
-
 vector<tuple<string, string, string, string>> parseTree(const string& treeSHA) {
-    // Use readObject to fetch the type and content of the tree object
-    pair<string, string> objectData = readObject(treeSHA);
-    string type = objectData.first;
-    string content = objectData.second;
+    // Use viewObject to read the tree in place, without copying its content
+    ObjectView object = viewObject(treeSHA);
 
-    if (type != "tree") { // Ensure the object type is "tree"
-        cerr << "Error: Object is not of type 'tree' for SHA " << treeSHA << endl;
-        return {};
+    if (object.type() != "tree") { // Ensure the object type is "tree"
+        throw runtime_error("Object is not of type 'tree' for SHA " + treeSHA);
     }
 
-    
-    string treeContent = content;
-
     vector<tuple<string, string, string, string>> entries; // Store (mode, objectType, sha, name)
 
-    stringstream contentStream(treeContent);
-    string line;
-    while (getline(contentStream, line)) {
-        stringstream lineStream(line);
-        string mode, objectType, sha, name;
-
-        if (!(lineStream >> mode >> objectType >> sha >> name)) {
-            cerr << "Error: Malformed tree entry in SHA " << treeSHA << endl;
-            continue;
+    string_view rest = object.content(), line;
+    while (nextLine(rest, line)) {
+        // Each entry is "mode objectType sha name"
+        size_t typeStart = line.find(' ');
+        size_t shaStart = typeStart == string_view::npos ? typeStart : line.find(' ', typeStart + 1);
+        size_t nameStart = shaStart == string_view::npos ? shaStart : line.find(' ', shaStart + 1);
+        if (nameStart == string_view::npos || nameStart + 1 >= line.size()) {
+            throw runtime_error("Malformed tree entry in SHA " + treeSHA);
         }
 
-        entries.emplace_back(mode, objectType, sha, name);
+        entries.emplace_back(string(line.substr(0, typeStart)),
+                             string(line.substr(typeStart + 1, shaStart - typeStart - 1)),
+                             string(line.substr(shaStart + 1, nameStart - shaStart - 1)),
+                             string(line.substr(nameStart + 1)));
     }
 
     return entries;
 }
 
 string getTreeSHA(const string& commitSHA) {
-    // Use readObject to fetch the type and content of the commit file
-    pair<string, string> objectData = readObject(commitSHA);
-    string type = objectData.first;
-    string content = objectData.second;
+    // View the commit without copying it out of the object cache
+    ObjectView object = viewObject(commitSHA);
 
-    if (type != "commit") { // Ensure the object type is "commit"
-        cerr << "Error: Object is not of type 'commit' for SHA " << commitSHA << endl;
-        return "";
+    if (object.type() != "commit") { // Ensure the object type is "commit"
+        throw runtime_error("Object is not of type 'commit' for SHA " + commitSHA);
     }
 
-    stringstream contentStream(content);
-    string line, treeSHA;
+    string_view rest = object.content(), line;
+    string treeSHA;
 
-    while (getline(contentStream, line)) {          // Read each line of the content
+    while (nextLine(rest, line) && !line.empty()) { // Header lines end at the first blank line
         if (line.rfind("tree ", 0) == 0) {          // Check if the line starts with "tree "
-            treeSHA = line.substr(5);               // Extract everything after "tree "
+            treeSHA = string(line.substr(5));       // Extract everything after "tree "
             break;
         }
     }
 
     if (treeSHA.empty()) {
-        cerr << "Error: Tree SHA not found in commit object for SHA " << commitSHA << endl;
+        throw runtime_error("Tree SHA not found in commit object for SHA " + commitSHA);
     }
-  
 
-    cout<<"tree sha is"<< treeSHA<<endl;
     return treeSHA;                                 // Return the extracted tree SHA
 }
 
+};
+struct Repository::Impl
+{
+    string root;
+    unique_ptr<MyGit> git;
+    mutex lock; // one operation at a time per Repository; separate repositories run independently
+};
+
+Repository::Repository(unique_ptr<Impl> state) : impl(move(state)) {}
+Repository::Repository(Repository &&) noexcept = default;
+Repository &Repository::operator=(Repository &&) noexcept = default;
+Repository::~Repository() = default;
+
+Repository Repository::init(const string &path)
+{
+    fs::create_directories(path);
+    Repository repo = open(path);
+    repo.impl->git->init();
+    return repo;
+}
+
+Repository Repository::open(const string &path)
+{
+    auto state = make_unique<Impl>();
+    state->root = fs::absolute(path).lexically_normal().string();
+    if (!fs::is_directory(state->root))
+    {
+        throw runtime_error("Not a directory: " + path);
+    }
+    state->git = make_unique<MyGit>(state->root);
+    return Repository(move(state));
+}
+
+const string &Repository::root() const
+{
+    return impl->root;
+}
+
+string Repository::hashObject(const string &file, bool write)
+{
+    lock_guard<mutex> guard(impl->lock);
+    string sha = impl->git->hashObject(file, write);
+    if (write)
+        impl->git->syncObjects();
+    return sha;
+}
+
+ObjectData Repository::readObject(const string &sha)
+{
+    lock_guard<mutex> guard(impl->lock);
+    shared_ptr<const ObjectCache::Entry> entry = impl->git->catFile(sha).buffer();
+    return {entry->type, entry->content, entry};
+}
+
+vector<ObjectInfo> Repository::readObjectInfo(const vector<string> &shas, unsigned jobs)
+{
+    lock_guard<mutex> guard(impl->lock);
+    return impl->git->catFileHeaders(shas, jobs);
+}
+
+ObjectInfo Repository::streamObject(const string &sha, const function<void(string_view)> &sink)
+{
+    lock_guard<mutex> guard(impl->lock);
+    return impl->git->streamObject(sha, sink);
+}
+
+vector<ObjectData> Repository::readObjects(const vector<string> &shas, unsigned jobs)
+{
+    lock_guard<mutex> guard(impl->lock);
+    vector<ObjectData> objects;
+    objects.reserve(shas.size());
+    for (shared_ptr<const ObjectCache::Entry> &entry : impl->git->catFiles(shas, jobs))
+    {
+        if (entry)
+            objects.push_back({entry->type, entry->content, entry});
+        else
+            objects.emplace_back();
+    }
+    return objects;
+}
 
-void createDirectories(const string& filePath) {
-    size_t lastSlash = filePath.find_last_of('/');
-    if (lastSlash == string::npos) return; // No directories in the path
+vector<TreeEntry> Repository::listTree(const string &treeSha)
+{
+    lock_guard<mutex> guard(impl->lock);
+    return impl->git->listTree(treeSha);
+}
 
-    string dirPath = filePath.substr(0, lastSlash); // Extract directory path
-    stringstream ss(dirPath);
-    string segment;
-    string currentPath = ".";
+string Repository::writeTree()
+{
+    lock_guard<mutex> guard(impl->lock);
+    string sha = impl->git->writeTree();
+    impl->git->syncObjects();
+    return sha;
+}
 
-    while (getline(ss, segment, '/')) { // Create each segment of the path
-        currentPath += "/" + segment;
-        mkdir(currentPath.c_str(), 0755); // Create directory if it doesn't exist
+AddResult Repository::add(const vector<string> &paths, const AddOptions &options)
+{
+    lock_guard<mutex> guard(impl->lock);
+    if (paths.size() == 1 && paths[0] == ".")
+    {
+        return impl->git->addAll(options.jobs, options.refresh);
     }
+    return impl->git->addFiles(paths, options.jobs, options.refresh);
+}
+
+CommitResult Repository::commit(const string &message)
+{
+    lock_guard<mutex> guard(impl->lock);
+    return impl->git->commitChanges(message);
+}
+
+vector<LogEntry> Repository::log(size_t maxCount)
+{
+    lock_guard<mutex> guard(impl->lock);
+    return impl->git->logCommits(maxCount);
+}
+
+StatusResult Repository::status(unsigned jobs)
+{
+    lock_guard<mutex> guard(impl->lock);
+    return impl->git->status(jobs);
+}
+
+CheckoutResult Repository::checkout(const string &commitSha, unsigned jobs, bool force)
+{
+    lock_guard<mutex> guard(impl->lock);
+    return impl->git->checkout(commitSha, jobs, force);
+}
+
+vector<DiffEntry> Repository::diff(const string &from, const string &to)
+{
+    lock_guard<mutex> guard(impl->lock);
+    return impl->git->diff(from, to);
+}
+
+void Repository::diffPatch(const string &from, const string &to, const function<void(string_view)> &write,
+                           unsigned context)
+{
+    lock_guard<mutex> guard(impl->lock);
+    impl->git->unifiedDiff(from, to, context, write);
+}
+
+RepackResult Repository::repack()
+{
+    lock_guard<mutex> guard(impl->lock);
+    return impl->git->repack();
+}
+
+FsckResult Repository::fsck(unsigned jobs)
+{
+    lock_guard<mutex> guard(impl->lock);
+    return impl->git->fsck(jobs);
+}
+
+size_t Repository::writeCommitGraph()
+{
+    lock_guard<mutex> guard(impl->lock);
+    return impl->git->writeCommitGraph();
 }
 
+bool Repository::isAncestor(const string &ancestor, const string &descendant)
+{
+    lock_guard<mutex> guard(impl->lock);
+    return impl->git->isAncestor(ancestor, descendant);
+}
+
+bool Repository::fsmonitorRunning()
+{
+    lock_guard<mutex> guard(impl->lock);
+    return impl->git->fsmonitorRunning();
+}
+
+pid_t Repository::startFsMonitor()
+{
+    lock_guard<mutex> guard(impl->lock);
+    return impl->git->startFsMonitor();
+}
 
-};
\ No newline at end of file
+bool Repository::stopFsMonitor()
+{
+    lock_guard<mutex> guard(impl->lock);
+    return impl->git->stopFsMonitor();
+}
+
+bool Repository::fsmonitorEnabled()
+{
+    return impl->git->fsmonitorEnabled();
+}
+
+ObjectCacheStats Repository::objectCacheStats() const
+{
+    return impl->git->objectCacheStats();
+}
@@ -0,0 +1,231 @@
+// libmygit: the MyGit engine as a library.
+//
+// A Repository is opened on an explicit working-tree path and keeps its configuration, object
+// cache, pack indexes and object-existence cache between calls, so tools can run many operations
+// in-process. Operations return their results; nothing is printed (warnings about corrupt
+// optional files still go to stderr). Errors are reported as std::runtime_error.
+//
+// Working-tree paths passed in and returned are relative to the repository root; the process
+// working directory is never read or changed. Calls on one Repository are serialized, calls on
+// different Repository objects run concurrently, and each operation may use several threads.
+#ifndef MYGIT_H
+#define MYGIT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <sys/types.h>
+#include <vector>
+
+// Hit/miss counters of the in-process object cache
+struct ObjectCacheStats
+{
+    size_t hits = 0;
+    size_t misses = 0;
+    size_t evictions = 0;
+    size_t bytes = 0;
+    size_t entries = 0;
+};
+
+// An inflated object. `content` stays valid as long as this value (or a copy) is alive.
+struct ObjectData
+{
+    std::string type;
+    std::string_view content;
+    std::shared_ptr<const void> owner;
+};
+
+// Type and size of an object, without its content
+struct ObjectInfo
+{
+    std::string type;
+    uint64_t size = 0;
+    bool chunked = false; // a large blob stored as chunks; streamObject avoids reassembling it
+};
+
+// One line of a tree object
+struct TreeEntry
+{
+    std::string mode;
+    std::string type; // "blob" or "tree"
+    std::string sha;
+    std::string name;
+};
+
+// A path together with what happened to it, e.g. "new file", "modified", "deleted" for status
+// or "added", "removed" for add
+struct PathChange
+{
+    std::string path;
+    std::string label;
+};
+
+// One file that differs between two trees
+struct DiffEntry
+{
+    char status = 'M';           // 'A' added, 'D' deleted, 'M' content or mode changed
+    std::string path;
+    std::string oldMode, oldSha; // empty for 'A'
+    std::string newMode, newSha; // empty for 'D'
+};
+
+struct AddOptions
+{
+    unsigned jobs = 0;    // worker threads; 0 = one per core
+    bool refresh = false; // rehash files even when their stat data is unchanged
+};
+
+struct AddResult
+{
+    std::vector<PathChange> changes; // index entries added or updated ("added") and dropped ("removed")
+    size_t filesSeen = 0;            // files considered
+    size_t filesHashed = 0;          // files actually read and hashed
+    uint64_t bytesHashed = 0;
+    double seconds = 0;
+    unsigned threads = 0;
+    size_t objectsWritten = 0;      // new objects stored by this repository so far
+    size_t objectsDeduplicated = 0; // writes skipped because the object was already stored
+};
+
+struct CommitResult
+{
+    std::string sha;
+    std::string parent; // empty for the first commit
+    std::string message;
+    size_t filesChanged = 0; // files added, deleted or modified relative to the parent commit
+};
+
+struct LogEntry
+{
+    std::string sha;
+    std::string parent;
+    std::string message; // first line
+    std::string committer;
+    time_t timestamp = 0;
+};
+
+struct StatusResult
+{
+    std::string head; // empty before the first commit
+    std::vector<PathChange> staged;   // HEAD vs index
+    std::vector<PathChange> unstaged; // index vs working tree
+    std::vector<std::string> untracked;
+
+    bool clean() const { return staged.empty() && unstaged.empty() && untracked.empty(); }
+};
+
+struct CheckoutResult
+{
+    std::string commit;
+    size_t written = 0;
+    size_t deleted = 0;
+    size_t unchanged = 0;
+    uint64_t bytesWritten = 0;
+    double seconds = 0;
+    unsigned threads = 0;
+};
+
+struct RepackResult
+{
+    size_t objects = 0; // 0 when there was nothing to pack
+    size_t deltas = 0;
+    std::string packName;
+    uint64_t packBytes = 0;
+    size_t looseObjectsRemoved = 0;
+    uint64_t looseBytesRemoved = 0;
+    size_t commitGraphCommits = 0; // commits in the rewritten commit-graph, 0 without history
+};
+
+// One problem found by fsck
+struct FsckIssue
+{
+    std::string sha;
+    std::string type;   // the stored type; for a missing object, the type it was expected to have
+    std::string detail; // what is wrong, or what refers to the missing object
+};
+
+struct FsckResult
+{
+    size_t looseObjects = 0;
+    size_t packedObjects = 0;
+    uint64_t bytes = 0;              // object content inflated and rehashed
+    std::vector<FsckIssue> corrupt;  // unreadable, malformed, wrongly typed or not matching their SHA
+    std::vector<FsckIssue> missing;  // reachable from HEAD or the index but not stored
+    std::vector<FsckIssue> dangling; // unreachable and not referenced by any other object
+    double seconds = 0;
+    unsigned threads = 0;
+
+    bool ok() const { return corrupt.empty() && missing.empty(); }
+};
+
+class MyGit;
+
+class Repository
+{
+public:
+    // Creates <path>/.mygit with the default configuration; throws if it already exists
+    static Repository init(const std::string &path);
+    // Opens the working tree at `path`. A missing .mygit is not an error here, so hashObject
+    // without `write` works anywhere; operations that need the repository fail on first use.
+    static Repository open(const std::string &path);
+
+    Repository(Repository &&) noexcept;
+    Repository &operator=(Repository &&) noexcept;
+    ~Repository();
+
+    const std::string &root() const;
+
+    // Objects
+    std::string hashObject(const std::string &file, bool write = false);
+    ObjectData readObject(const std::string &sha);
+    // Reads the objects on `jobs` threads (0 = one per core), in order; missing ones have an empty type
+    std::vector<ObjectData> readObjects(const std::vector<std::string> &shas, unsigned jobs = 0);
+    // Like readObjects, but loose objects only have their header inflated
+    std::vector<ObjectInfo> readObjectInfo(const std::vector<std::string> &shas, unsigned jobs = 0);
+    // Passes the content to `sink` in order; a chunked blob arrives one chunk at a time, so it is
+    // never held in memory whole. Throws if the object does not exist.
+    ObjectInfo streamObject(const std::string &sha, const std::function<void(std::string_view)> &sink);
+    std::vector<TreeEntry> listTree(const std::string &treeSha);
+    std::string writeTree();
+
+    // Index and history
+    AddResult add(const std::vector<std::string> &paths, const AddOptions &options = {}); // {"."} adds everything
+    CommitResult commit(const std::string &message);
+    std::vector<LogEntry> log(size_t maxCount = 0);
+    StatusResult status(unsigned jobs = 0);
+    // Refuses to overwrite or delete files with local changes unless `force` is set
+    CheckoutResult checkout(const std::string &commitSha, unsigned jobs = 0, bool force = false);
+    // Files that differ between two commits or trees, sorted by path
+    std::vector<DiffEntry> diff(const std::string &from, const std::string &to);
+    // Unified diff ("diff --git" headers and hunks with `context` lines) between two commits or
+    // trees, or between two blobs; the text is handed to `write` in pieces as it is produced
+    void diffPatch(const std::string &from, const std::string &to, const std::function<void(std::string_view)> &write,
+                   unsigned context = 3);
+
+    // Maintenance
+    RepackResult repack();
+    // Rehashes every loose and packed object on `jobs` threads and checks connectivity from HEAD
+    FsckResult fsck(unsigned jobs = 0);
+    size_t writeCommitGraph();
+    bool isAncestor(const std::string &ancestor, const std::string &descendant);
+
+    // fsmonitor daemon for this working tree
+    bool fsmonitorRunning();
+    pid_t startFsMonitor(); // forks the daemon; returns its pid, or 0 if one was already running
+    bool stopFsMonitor();   // false when no daemon was running
+    bool fsmonitorEnabled(); // core.fsmonitor in the repository config
+
+    ObjectCacheStats objectCacheStats() const;
+
+private:
+    struct Impl;
+    std::unique_ptr<Impl> impl;
+
+    explicit Repository(std::unique_ptr<Impl> state);
+};
+
+#endif